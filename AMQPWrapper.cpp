@@ -1,46 +1,92 @@
 #include "AMQPWrapper.h"
+#include <utility>
+#include "Logger.h"
 
 AMQPWrapper *cb_obj_wrapper;
 
-AMQPWrapper::AMQPWrapper(std::string _connstr) : amqp(_connstr), exchange(this->amqp.createExchange("RF24NodeEx")), queue(this->amqp.createQueue("RF24Node"))  {
+AMQPWrapper::AMQPWrapper(std::string _connstr) : connstr(_connstr), exchange(nullptr), queue(nullptr),
+  subscriptions({ ".sensornet.in.#" }), is_connected(false) {
     cb_obj_wrapper = this;
 }
 
+/*
+ * Connect and set up the channels; throws if the broker is unreachable
+ */
 void AMQPWrapper::begin(void) {
-    printf("Connecting to AMQP\n");
+    logger.info(CAT_BROKER, "Connecting to AMQP\n");
+    this->amqp.reset(new AMQP(this->connstr));
+    this->exchange = this->amqp->createExchange("RF24NodeEx");
+    this->queue = this->amqp->createQueue("RF24Node");
+
     this->exchange->Declare("RF24NodeEx", "topic");
     this->queue->Declare();
-    this->queue->Bind("RF24NodeEx", ".sensornet.in.#");
+    for (auto &topic : this->subscriptions) {
+        this->queue->Bind("RF24NodeEx", topic);
+    }
+    this->is_connected = true;
 
     this->queue->addEvent(AMQP_MESSAGE, AMQPWrapper::amqp_on_message);
 }
 
 void AMQPWrapper::end(void) {
+    this->is_connected = false;
 }
 
 void AMQPWrapper::loop(void) {
+    if (this->is_connected || std::chrono::steady_clock::now() < this->next_connect) {
+        return;
+    }
+
+    try {
+        this->begin();
+    } catch (...) {
+        logger.warn(CAT_BROKER, "Connecting to AMQP failed; retrying in 15 s\n");
+        this->next_connect = std::chrono::steady_clock::now() + std::chrono::seconds(15);
+    }
 }
 
-void AMQPWrapper::send_message(std::string subject, std::string body) {
-    this->exchange->Publish(body, subject);
+void AMQPWrapper::send_message(const std::string& subject, const std::string& body) {
+    try {
+        this->exchange->Publish(body, subject);
+    } catch (...) {
+        this->on_disconnect(0);
+    }
 }
 
 void AMQPWrapper::set_on_message_callback(on_msg_cb cb) {
-    this->cb = cb;
+    this->cb = std::move(cb);
+}
+
+void AMQPWrapper::add_subscription(const std::string& topic) {
+    if (this->subscriptions.insert(topic).second && this->is_connected) {
+        this->queue->Bind("RF24NodeEx", topic);
+    }
+}
+
+void AMQPWrapper::remove_subscription(const std::string& topic) {
+    if (this->subscriptions.erase(topic) && this->is_connected) {
+        this->queue->unBind("RF24NodeEx", topic);
+    }
+}
+
+bool AMQPWrapper::connected(void) {
+    return this->is_connected;
 }
 
+/*
+ * Never block here; loop() reconnects once the holdoff has passed
+ */
 void AMQPWrapper::on_disconnect(int mid) {
-    printf("Disconnecting from AMQP\n");
+    logger.warn(CAT_BROKER, "Disconnecting from AMQP\n");
     this->end();
-    sleep(15);
-    this->begin();
+    this->next_connect = std::chrono::steady_clock::now() + std::chrono::seconds(15);
 }
 
 void AMQPWrapper::on_message(AMQPMessage *message) {
     uint32_t j = 0;
     auto subject = message->getRoutingKey();
     auto body = std::string(message->getMessage(&j), j);
-    this->cb(subject, body);
+    this->cb(subject, std::move(body));
 }
 
 int AMQPWrapper::amqp_on_message(AMQPMessage *message) {
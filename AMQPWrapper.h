@@ -1,7 +1,10 @@
 #pragma once
 
 #include "IMessageProtocol.h" 
+#include <chrono>
 #include <functional>
+#include <memory>
+#include <set>
 #include "libs/amqpcpp/include/AMQPcpp.h"
 
 class AMQPWrapper: public IMessageProtocol {
@@ -10,14 +13,21 @@ class AMQPWrapper: public IMessageProtocol {
         void begin(void);
         void end(void);
         void loop(void);
-        void send_message(std::string subject, std::string body);
+        void send_message(const std::string& subject, const std::string& body);
         void set_on_message_callback(on_msg_cb cb);
+        void add_subscription(const std::string& topic);
+        void remove_subscription(const std::string& topic);
+        bool connected(void);
         static int amqp_on_message(AMQPMessage *message);
 
     protected:
-        AMQP amqp;
+        std::string connstr;
+        std::unique_ptr<AMQP> amqp; /* Connected in begin(); owns the exchange and queue */
         AMQPExchange* exchange;
         AMQPQueue* queue;
+        std::set<std::string> subscriptions;
+        bool is_connected;
+        std::chrono::steady_clock::time_point next_connect; /* Reconnect from loop() once this passes */
         on_msg_cb cb;
         void on_message(AMQPMessage *message);
         void on_disconnect(int mid);
@@ -3,13 +3,17 @@
 #include <string>
 #include <functional>
 
-typedef std::function<void(std::string, std::string)> on_msg_cb;
+/* The body is handed over as an rvalue so receivers can move it instead of copying */
+typedef std::function<void(const std::string& subject, std::string&& body)> on_msg_cb;
 
 class IMessageProtocol {
     public:
         virtual void begin(void) { };
         virtual void end(void) { };
         virtual void loop(void) { };
-        virtual void send_message(std::string subject, std::string body) { };
+        virtual void send_message(const std::string& subject, const std::string& body) { };
         virtual void set_on_message_callback(on_msg_cb cb) { };
+        virtual void add_subscription(const std::string& topic) { };
+        virtual void remove_subscription(const std::string& topic) { };
+        virtual bool connected(void) { return true; };
 };
@@ -1,9 +1,16 @@
 #pragma once
 
 #include <cstddef>
+#include <stdint.h>
 
 struct RF24NetworkHeader; 
 
+/* Outcome of a single radio write */
+struct radio_write_result_t {
+    bool acked;
+    uint8_t retries; /* Auto-retransmits the radio used */
+};
+
 class IRadioNetwork {
     public:
         virtual void begin(void) { };
@@ -12,4 +19,9 @@ class IRadioNetwork {
         virtual void peek(RF24NetworkHeader& header) { };
         virtual size_t read(RF24NetworkHeader& header, void* message, size_t maxlen) { return 0; };
         virtual bool write(RF24NetworkHeader& header, const void* message, size_t len) { return false; };
+        virtual bool write(RF24NetworkHeader& header, const void* message, size_t len, radio_write_result_t& result) { 
+            result.acked = this->write(header, message, len);
+            result.retries = 0;
+            return result.acked;
+        };
 };
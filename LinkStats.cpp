@@ -0,0 +1,53 @@
+#include "LinkStats.h"
+#include "Logger.h"
+
+const double LINK_AVERAGE_WEIGHT = 0.2;
+const uint64_t LINK_MIN_WRITES = 10;
+
+void LinkStats::record(uint16_t node, const radio_write_result_t& result) {
+    auto found = this->links.find(node);
+    if (found == this->links.end()) {
+        // Assume a good link until shown otherwise
+        found = this->links.insert(std::make_pair(node, link_stats_t { 0, 0, 0, 0, 1.0, 0.0, false })).first;
+    }
+
+    auto &link = found->second;
+    link.writes++;
+    link.acked += result.acked ? 1 : 0;
+    link.failed += result.acked ? 0 : 1;
+    link.hw_retries += result.retries;
+    link.success += LINK_AVERAGE_WEIGHT * ((result.acked ? 1.0 : 0.0) - link.success);
+    link.retries += LINK_AVERAGE_WEIGHT * (result.retries - link.retries);
+
+    // Hysteresis so a marginal node doesn't flap
+    if (!link.needs_repeater && link.writes >= LINK_MIN_WRITES && link.success < 0.5) {
+        link.needs_repeater = true;
+        logger.warn(CAT_RADIO, "Node 0%o is only acking %.0f%% of writes; it may need a repeater\n", node, link.success * 100);
+    } else if (link.needs_repeater && link.success > 0.7) {
+        link.needs_repeater = false;
+        logger.info(CAT_RADIO, "Node 0%o link recovered\n", node);
+    }
+}
+
+/*
+ * Software write attempts for a node
+ */
+uint8_t LinkStats::attempts(uint16_t node) const {
+    auto found = this->links.find(node);
+    if (found == this->links.end()) {
+        return 1;
+    }
+
+    auto &link = found->second;
+    if (link.success >= 0.9 && link.retries < 3) return 1;
+    if (link.success >= 0.7) return 2;
+    if (link.success >= 0.4) return 3;
+    return 4;
+}
+
+/*
+ * Pause between software attempts, giving a weak link time to clear
+ */
+std::chrono::milliseconds LinkStats::spacing(uint16_t node) const {
+    return std::chrono::milliseconds(5 * (this->attempts(node) - 1));
+}
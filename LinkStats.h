@@ -0,0 +1,36 @@
+#pragma once
+
+#include <chrono>
+#include <unordered_map>
+#include <stdint.h>
+#include "IRadioNetwork.h"
+
+/* Write history for one destination node */
+struct link_stats_t {
+    uint64_t writes; /* Radio write attempts */
+    uint64_t acked;
+    uint64_t failed;
+    uint64_t hw_retries; /* Auto-retransmits used across all attempts */
+    double success; /* Moving average of acked attempts, 0..1 */
+    double retries; /* Moving average of auto-retransmits per attempt */
+    bool needs_repeater;
+};
+
+/*
+ * Per-destination write outcomes, and the write strategy derived from them:
+ * strong links get a single attempt, weak links more attempts spaced further apart.
+ */
+class LinkStats {
+    public:
+        void record(uint16_t node, const radio_write_result_t& result);
+
+        uint8_t attempts(uint16_t node) const;
+        std::chrono::milliseconds spacing(uint16_t node) const;
+
+        const std::unordered_map<uint16_t, link_stats_t>& all(void) const {
+            return this->links;
+        }
+
+    protected:
+        std::unordered_map<uint16_t, link_stats_t> links;
+};
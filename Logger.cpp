@@ -0,0 +1,172 @@
+#include <ctime>
+#include <syslog.h>
+#include "Logger.h"
+
+Logger logger;
+
+static const char* level_names[] = { "ERROR", "WARN", "INFO", "DEBUG" };
+static const int level_priorities[] = { LOG_ERR, LOG_WARNING, LOG_INFO, LOG_DEBUG };
+static const char* category_names[] = { "gateway", "radio", "broker", "auth" };
+
+Logger::Logger(void) : level(LEVEL_INFO), running(false), file(stdout), use_syslog(false) { }
+
+Logger::~Logger(void) {
+    this->stop();
+    if (this->file != stdout) {
+        fclose(this->file);
+    }
+}
+
+bool Logger::open_file(const std::string& path) {
+    auto f = fopen(path.c_str(), "a");
+    if (f == nullptr) {
+        return false;
+    }
+
+    this->file = f;
+    return true;
+}
+
+void Logger::open_syslog(void) {
+    openlog("rf24node", LOG_PID, LOG_DAEMON);
+    this->use_syslog = true;
+}
+
+void Logger::start(void) {
+    if (this->running.exchange(true)) {
+        return;
+    }
+    this->writer = std::thread(&Logger::run, this);
+}
+
+void Logger::stop(void) {
+    if (!this->running.exchange(false)) {
+        return;
+    }
+    this->writer.join();
+    this->drain();
+}
+
+LogRing& Logger::local_ring(void) {
+    static thread_local LogRing* ring = nullptr;
+    if (ring == nullptr) {
+        std::lock_guard<std::mutex> lock(this->rings_mutex);
+        this->rings.push_back(std::unique_ptr<LogRing>(new LogRing()));
+        ring = this->rings.back().get();
+    }
+    return *ring;
+}
+
+void Logger::run(void) {
+    while (this->running.load(std::memory_order_acquire)) {
+        if (this->drain() == 0) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+    }
+}
+
+/*
+ * Write everything waiting in every ring; returns the number of records written
+ */
+size_t Logger::drain(void) {
+    std::lock_guard<std::mutex> lock(this->rings_mutex);
+
+    auto written = size_t(0);
+    for (auto &ring : this->rings) {
+        const log_record_t* record;
+        while ((record = ring->peek()) != nullptr) {
+            this->write(*record);
+            ring->release();
+            written++;
+        }
+
+        auto dropped = ring->take_dropped();
+        if (dropped > 0) {
+            auto r = log_record_t();
+            r.when = std::chrono::system_clock::now();
+            r.format = "Log ring full; dropped %llu records\n";
+            r.level = LEVEL_WARN;
+            r.category = CAT_GATEWAY;
+            log_encode(r, dropped);
+            this->write(r);
+        }
+    }
+
+    if (written > 0 && !this->use_syslog) {
+        fflush(this->file);
+    }
+    return written;
+}
+
+void Logger::write(const log_record_t& record) {
+    auto message = this->format(record);
+    if (!message.empty() && message.back() == '\n') {
+        message.pop_back();
+    }
+
+    if (this->use_syslog) {
+        syslog(level_priorities[record.level], "%s: %s", category_names[record.category], message.c_str());
+        return;
+    }
+
+    auto when = std::chrono::system_clock::to_time_t(record.when);
+    auto millis = std::chrono::duration_cast<std::chrono::milliseconds>(record.when.time_since_epoch()).count() % 1000;
+    struct tm local;
+    localtime_r(&when, &local);
+
+    char stamp[32];
+    strftime(stamp, sizeof(stamp), "%Y-%m-%d %H:%M:%S", &local);
+    fprintf(this->file, "%s.%03d %-5s %s: %s\n", stamp, int(millis), level_names[record.level], 
+        category_names[record.category], message.c_str());
+}
+
+/*
+ * Expand a printf style format against the captured arguments, one conversion at a time
+ */
+std::string Logger::format(const log_record_t& record) const {
+    auto out = std::string();
+    auto arg = size_t(0);
+    char buf[256];
+
+    for (auto p = record.format; *p; ) {
+        if (*p != '%') {
+            out += *p++;
+            continue;
+        }
+        if (p[1] == '%') {
+            out += '%';
+            p += 2;
+            continue;
+        }
+
+        // Keep flags, width and precision; length modifiers are replaced by the captured type
+        auto spec = std::string("%");
+        for (p++; *p && strchr("-+ #0123456789.", *p); p++) spec += *p;
+        for (; *p && strchr("hlLzjtq", *p); p++) { }
+        auto conv = *p ? *p++ : 's';
+
+        if (arg >= record.nargs) {
+            out += "?";
+            continue;
+        }
+
+        auto type = record.types[arg];
+        auto &value = record.args[arg++];
+        if (conv == 's' || type == 's') {
+            snprintf(buf, sizeof(buf), (spec + "s").c_str(), type == 's' ? record.text + value.text : "?");
+        } else if (strchr("fFeEgGaA", conv)) {
+            snprintf(buf, sizeof(buf), (spec + conv).c_str(), type == 'd' ? value.d : double(value.i));
+        } else if (strchr("uoxXp", conv)) {
+            snprintf(buf, sizeof(buf), (spec + "ll" + (conv == 'p' ? 'x' : conv)).c_str(), 
+                static_cast<unsigned long long>(type == 'd' ? int64_t(value.d) : value.i));
+        } else if (conv == 'c') {
+            snprintf(buf, sizeof(buf), (spec + "c").c_str(), int(type == 'd' ? value.d : value.i));
+        } else {
+            snprintf(buf, sizeof(buf), (spec + "lld").c_str(), 
+                static_cast<long long>(type == 'd' ? int64_t(value.d) : value.i));
+        }
+        out += buf;
+    }
+
+    return out;
+}
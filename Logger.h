@@ -0,0 +1,221 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <stdint.h>
+
+enum log_level {
+    LEVEL_ERROR = 0,
+    LEVEL_WARN = 1,
+    LEVEL_INFO = 2,
+    LEVEL_DEBUG = 3,
+};
+
+enum log_category {
+    CAT_GATEWAY = 0,
+    CAT_RADIO = 1,
+    CAT_BROKER = 2,
+    CAT_AUTH = 3,
+};
+
+const size_t LOG_MAX_ARGS = 12;
+const size_t LOG_TEXT_BYTES = 192;
+const size_t LOG_RING_RECORDS = 1024;
+
+/* A log call captured in binary form; formatting is deferred to the writer thread */
+struct log_record_t {
+    std::chrono::system_clock::time_point when;
+    const char* format; /* Must be a string literal */
+    uint8_t level;
+    uint8_t category;
+    uint8_t nargs;
+    char types[LOG_MAX_ARGS]; /* 'i'nteger, 'd'ouble or 's'tring */
+    union {
+        int64_t i;
+        double d;
+        uint16_t text; /* Offset into text */
+    } args[LOG_MAX_ARGS];
+    uint16_t text_used;
+    char text[LOG_TEXT_BYTES];
+};
+
+inline void log_encode(log_record_t& r, const char* s) {
+    if (r.nargs >= LOG_MAX_ARGS) return;
+
+    auto avail = LOG_TEXT_BYTES - r.text_used;
+    auto &arg = r.args[r.nargs];
+    r.types[r.nargs++] = 's';
+    if (avail == 0) {
+        arg.text = LOG_TEXT_BYTES - 1;
+        return;
+    }
+
+    // Strings are copied, truncated to whatever room the record has left
+    auto n = std::min(strlen(s), avail - 1);
+    arg.text = r.text_used;
+    memcpy(r.text + r.text_used, s, n);
+    r.text[r.text_used + n] = 0;
+    r.text_used += n + 1;
+}
+
+inline void log_encode(log_record_t& r, char* s) { log_encode(r, static_cast<const char*>(s)); }
+inline void log_encode(log_record_t& r, const std::string& s) { log_encode(r, s.c_str()); }
+
+inline void log_encode(log_record_t& r, double d) {
+    if (r.nargs >= LOG_MAX_ARGS) return;
+    r.args[r.nargs].d = d;
+    r.types[r.nargs++] = 'd';
+}
+
+inline void log_encode(log_record_t& r, float f) { log_encode(r, static_cast<double>(f)); }
+
+template<typename T>
+inline void log_encode(log_record_t& r, T v) {
+    if (r.nargs >= LOG_MAX_ARGS) return;
+    r.args[r.nargs].i = static_cast<int64_t>(v);
+    r.types[r.nargs++] = 'i';
+}
+
+inline void log_encode_all(log_record_t&) { }
+
+template<typename T, typename... Rest>
+inline void log_encode_all(log_record_t& r, const T& v, const Rest&... rest) {
+    log_encode(r, v);
+    log_encode_all(r, rest...);
+}
+
+/*
+ * Single producer, single consumer ring of records; the producer fills records in place
+ */
+class LogRing {
+    public:
+        LogRing(void) : head(0), tail(0), dropped(0) { }
+
+        log_record_t* claim(void) {
+            auto h = this->head.load(std::memory_order_relaxed);
+            if (h - this->tail.load(std::memory_order_acquire) >= LOG_RING_RECORDS) {
+                this->dropped.fetch_add(1, std::memory_order_relaxed);
+                return nullptr;
+            }
+            return &this->records[h % LOG_RING_RECORDS];
+        }
+
+        void commit(void) {
+            this->head.store(this->head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+        }
+
+        const log_record_t* peek(void) const {
+            auto t = this->tail.load(std::memory_order_relaxed);
+            if (t == this->head.load(std::memory_order_acquire)) {
+                return nullptr;
+            }
+            return &this->records[t % LOG_RING_RECORDS];
+        }
+
+        void release(void) {
+            this->tail.store(this->tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+        }
+
+        uint64_t take_dropped(void) {
+            return this->dropped.exchange(0, std::memory_order_relaxed);
+        }
+
+    protected:
+        std::array<log_record_t, LOG_RING_RECORDS> records;
+        std::atomic<size_t> head;
+        std::atomic<size_t> tail;
+        std::atomic<uint64_t> dropped;
+};
+
+/*
+ * Leveled, categorised logger; callers write into a per-thread ring and a
+ * background thread formats and writes the records to stdout, a file or syslog
+ */
+class Logger {
+    public:
+        Logger(void);
+        ~Logger(void);
+
+        void set_level(log_level _level) {
+            this->level.store(_level, std::memory_order_relaxed);
+        }
+
+        bool enabled(log_level l) const {
+            return l <= this->level.load(std::memory_order_relaxed);
+        }
+
+        bool open_file(const std::string& path);
+        void open_syslog(void);
+        void start(void);
+        void stop(void);
+
+        template<typename... Args>
+        void log(log_level l, log_category category, const char* format, const Args&... args) {
+            if (!this->enabled(l)) return;
+
+            auto &ring = this->local_ring();
+            auto record = ring.claim();
+            if (record == nullptr) return;
+
+            record->when = std::chrono::system_clock::now();
+            record->format = format;
+            record->level = l;
+            record->category = category;
+            record->nargs = 0;
+            record->text_used = 0;
+            log_encode_all(*record, args...);
+
+            // Until the writer thread runs, write synchronously
+            if (!this->running.load(std::memory_order_acquire)) {
+                this->write(*record);
+                return;
+            }
+            ring.commit();
+        }
+
+        template<typename... Args> void error(log_category c, const char* f, const Args&... a) { this->log(LEVEL_ERROR, c, f, a...); }
+        template<typename... Args> void warn(log_category c, const char* f, const Args&... a) { this->log(LEVEL_WARN, c, f, a...); }
+        template<typename... Args> void info(log_category c, const char* f, const Args&... a) { this->log(LEVEL_INFO, c, f, a...); }
+        template<typename... Args> void debug(log_category c, const char* f, const Args&... a) { this->log(LEVEL_DEBUG, c, f, a...); }
+
+    protected:
+        std::atomic<int> level;
+        std::atomic<bool> running;
+        std::thread writer;
+
+        std::mutex rings_mutex;
+        std::vector<std::unique_ptr<LogRing>> rings;
+
+        FILE* file;
+        bool use_syslog;
+
+        LogRing& local_ring(void);
+        void run(void);
+        size_t drain(void);
+        void write(const log_record_t& record);
+        std::string format(const log_record_t& record) const;
+};
+
+extern Logger logger;
+
+/*
+ * `make check-format` compiles every source with LOG_FORMAT_CHECK defined: each
+ * logger.LEVEL(category, format, args...) call is then also checked as a printf
+ * call, so -Wformat catches argument counts and types that don't match the format
+ */
+#ifdef LOG_FORMAT_CHECK
+void log_format_check(const char* format, ...) __attribute__((format(printf, 1, 2)));
+#define error(c, ...) error(c, __VA_ARGS__), log_format_check(__VA_ARGS__)
+#define warn(c, ...) warn(c, __VA_ARGS__), log_format_check(__VA_ARGS__)
+#define info(c, ...) info(c, __VA_ARGS__), log_format_check(__VA_ARGS__)
+#define debug(c, ...) debug(c, __VA_ARGS__), log_format_check(__VA_ARGS__)
+#endif
@@ -1,20 +1,36 @@
 #include "MQTTWrapper.h"
-#include <unistd.h>
+#include <algorithm>
+#include "Logger.h"
+#include <utility>
 
 MQTTWrapper::MQTTWrapper(std::string id, std::string host, int port, std::string tls_ca_file, std::string tls_cert_file, std::string tls_key_file, bool tls_insecure_mode) : 
-    mosqpp::mosquittopp(id.c_str(), true), host(host), port(port), tls_ca_file(tls_ca_file), tls_cert_file(tls_cert_file), tls_key_file(tls_key_file), tls_insecure_mode(tls_insecure_mode) {}
+    mosqpp::mosquittopp(id.c_str(), true), host(host), port(port), tls_ca_file(tls_ca_file), tls_cert_file(tls_cert_file), tls_key_file(tls_key_file), tls_insecure_mode(tls_insecure_mode),
+    subscriptions({ "/sensornet/in/#" }), is_connected(false), backoff(1) {}
 
 void MQTTWrapper::begin(void) {
     mosqpp::lib_init();
 
     if (!this->tls_ca_file.empty() && !this->tls_cert_file.empty() && !this->tls_key_file.empty()) {
-        printf("Enabling TLS mode.\n");
+        logger.info(CAT_BROKER, "Enabling TLS mode.\n");
         this->tls_set(this->tls_ca_file.c_str(), NULL, this->tls_cert_file.c_str(), this->tls_key_file.c_str());
         this->tls_insecure_set(this->tls_insecure_mode);
     }
 
-    printf("Connecting to MQTT\n");
-    this->connect(this->host.c_str(), this->port, 60 /* keepalive */);
+    this->try_connect();
+}
+
+/*
+ * Start a non-blocking connect; loop() tries again after the backoff unless on_connect succeeds first
+ */
+void MQTTWrapper::try_connect(void) {
+    logger.info(CAT_BROKER, "Connecting to MQTT\n");
+    auto rc = this->connect_async(this->host.c_str(), this->port, 60 /* keepalive */);
+    if (rc != MOSQ_ERR_SUCCESS) {
+        logger.warn(CAT_BROKER, "Connecting to MQTT failed (%d); retrying in %lld s\n", rc, static_cast<long long>(this->backoff.count()));
+    }
+
+    this->next_connect = std::chrono::steady_clock::now() + this->backoff;
+    this->backoff = std::min(this->backoff * 2, std::chrono::seconds(60));
 }
 
 void MQTTWrapper::end(void) {
@@ -22,40 +38,66 @@ void MQTTWrapper::end(void) {
 }
 
 void MQTTWrapper::loop(void) {
+    if (!this->is_connected && std::chrono::steady_clock::now() >= this->next_connect) {
+        this->try_connect();
+    }
     mosqpp::mosquittopp::loop();
 }
 
-void MQTTWrapper::send_message(std::string subject, std::string body) {
+void MQTTWrapper::send_message(const std::string& subject, const std::string& body) {
     this->publish(nullptr, subject.c_str(), body.length(), body.c_str(), 0); 
 }
 
 void MQTTWrapper::set_on_message_callback(on_msg_cb cb) {
-    this->cb = cb;
+    this->cb = std::move(cb);
+}
+
+void MQTTWrapper::add_subscription(const std::string& topic) {
+    if (this->subscriptions.insert(topic).second && this->is_connected) {
+        this->subscribe(nullptr, topic.c_str());
+    }
+}
+
+void MQTTWrapper::remove_subscription(const std::string& topic) {
+    if (this->subscriptions.erase(topic) && this->is_connected) {
+        this->unsubscribe(nullptr, topic.c_str());
+    }
 }
 
 void MQTTWrapper::on_connect(int rc) {
     if (rc == 0) {
-        printf("Connected to MQTT\n");
-        this->subscribe(nullptr, "/sensornet/in/#");
+        logger.info(CAT_BROKER, "Connected to MQTT\n");
+        this->is_connected = true;
+        this->backoff = std::chrono::seconds(1);
+        for (auto &topic : this->subscriptions) {
+            this->subscribe(nullptr, topic.c_str());
+        }
     } else {
-        printf("Connection error; reason code %d\n", rc);
+        logger.error(CAT_BROKER, "Connection error; reason code %d\n", rc);
     }
 }
 
 void MQTTWrapper::on_log(int level, const char *str) {
-    //printf("LOG [%d] %s\n", level, str);
+    // mosquitto logs every packet; too chatty for the loop thread, even at debug
+}
+
+bool MQTTWrapper::connected(void) {
+    return this->is_connected;
 }
 
-void MQTTWrapper::on_disconnect(int mid) {
-    printf("Disconnected from MQTT\n");
-    this->end();
-    sleep(15);
-    this->begin();
+/*
+ * Never block here: this runs on the radio loop thread, and loop() reconnects with backoff
+ */
+void MQTTWrapper::on_disconnect(int rc) {
+    logger.warn(CAT_BROKER, "Disconnected from MQTT (%d)\n", rc);
+    this->is_connected = false;
+    this->next_connect = std::chrono::steady_clock::now() + this->backoff;
 }
 
 void MQTTWrapper::on_message(const struct mosquitto_message *message) {
+    // Binary safe; payloads are not NUL terminated and may contain NULs
     auto subject = std::string(message->topic);
     auto body = message->payloadlen > 0 ? 
-        std::string(reinterpret_cast<char *>(message->payload)) : std::string("");
-    this->cb(subject, body);
+        std::string(static_cast<const char *>(message->payload), message->payloadlen) : std::string();
+    this->cb(subject, std::move(body));
 }
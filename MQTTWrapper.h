@@ -1,7 +1,9 @@
 #pragma once
 
 #include "IMessageProtocol.h" 
+#include <chrono>
 #include <functional>
+#include <set>
 #include <mosquittopp.h>
 
 class MQTTWrapper: public IMessageProtocol, public mosqpp::mosquittopp {
@@ -10,8 +12,11 @@ class MQTTWrapper: public IMessageProtocol, public mosqpp::mosquittopp {
         void begin(void);
         void end(void);
         void loop(void);
-        void send_message(std::string subject, std::string body);
+        void send_message(const std::string& subject, const std::string& body);
         void set_on_message_callback(on_msg_cb cb);
+        void add_subscription(const std::string& topic);
+        void remove_subscription(const std::string& topic);
+        bool connected(void);
 
     protected:
         std::string host;
@@ -22,9 +27,17 @@ class MQTTWrapper: public IMessageProtocol, public mosqpp::mosquittopp {
         std::string tls_key_file;
         bool tls_insecure_mode;
 
+        std::set<std::string> subscriptions;
+        bool is_connected;
+
+        /* Connection attempts back off from 1 s up to a minute while the broker is unreachable */
+        std::chrono::steady_clock::time_point next_connect;
+        std::chrono::seconds backoff;
+        void try_connect(void);
+
         on_msg_cb cb;
         void on_message(const struct mosquitto_message *message);
-        void on_disconnect(int mid);
+        void on_disconnect(int rc);
         void on_log(int level, const char *str);
         void on_connect(int rc);
 };
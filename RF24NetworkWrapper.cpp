@@ -31,3 +31,9 @@ size_t RF24NetworkWrapper::read(RF24NetworkHeader& header, void* message, size_t
 bool RF24NetworkWrapper::write(RF24NetworkHeader& header,const void* message, size_t len) {
     return this->network.write(header, message, len);
 }
+
+bool RF24NetworkWrapper::write(RF24NetworkHeader& header,const void* message, size_t len, radio_write_result_t& result) {
+    result.acked = this->network.write(header, message, len);
+    result.retries = this->radio.getARC();
+    return result.acked;
+}
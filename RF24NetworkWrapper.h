@@ -15,6 +15,7 @@ class RF24NetworkWrapper: public IRadioNetwork {
         void peek(RF24NetworkHeader& header);
         size_t read(RF24NetworkHeader& header, void* message, size_t maxlen);
         bool write(RF24NetworkHeader& header,const void* message, size_t len);
+        bool write(RF24NetworkHeader& header,const void* message, size_t len, radio_write_result_t& result);
 
     protected:
         uint8_t channel;
@@ -9,28 +9,133 @@
 #include <string>
 #include <sstream>
 #include <vector>
+#include <utility>
 #include <ctime>
+#include <cstring>
 
 #include "libs/csiphash/csiphash.c"
 #include "StringSplit.h"
+#include "Logger.h"
 #include "IMessageProtocol.h"
 #include "IRadioNetwork.h"
 #include "RF24Node.h"
 
 RF24Node::RF24Node(IRadioNetwork& _network, IMessageProtocol& _msg_proto, std::vector<char> _key) : 
-  msg_proto(_msg_proto), network(_network), key(_key), topic_separator('/') { }
+  msg_proto(_msg_proto), network(_network), key(_key), topic_separator('/'),
+  next_job(1), challenge_window(8), challenge_timeout(250), challenge_attempts(3), max_queued_commands(16),
+  sharding(false), heartbeat_interval(10), stats_interval(60), frames_received(0), frames_malformed(0),
+  auth_stats({ 0, 0, 0, 0 }), broker_ready(false), subscriptions_dirty(false), max_pending_publishes(512) { }
 
+/*
+ * Bring the radio up first so frames are handled (and time sync answered) straight away;
+ * the broker connects in the background and publishes are buffered until it is up
+ */
 void RF24Node::begin(void) {
-    this->msg_proto.set_on_message_callback([this](std::string subject, std::string body) { this->handle_receive_message(subject, body); });
-    this->msg_proto.begin();
-
+    this->startup.started = steady_clock::now();
     this->network.begin();
+    this->startup.radio_ready = steady_clock::now();
+    logger.info(CAT_RADIO, "Radio ready after %lld ms\n", this->startup_ms(this->startup.radio_ready));
+
+    this->msg_proto.set_on_message_callback([this](const std::string& subject, std::string&& body) { this->handle_receive_message(subject, std::move(body)); });
+    if (this->sharding) {
+        this->update_subscriptions();
+    }
+    this->broker_begin = std::async(std::launch::async, [this]() { this->msg_proto.begin(); });
 }
 
 void RF24Node::end(void) {
+    if (this->broker_begin.valid()) {
+        this->broker_begin.wait();
+    }
     this->msg_proto.end();
 }
 
+/*
+ * Publish now if the broker is up, otherwise buffer (dropping the oldest beyond the limit)
+ */
+void RF24Node::publish(const std::string& topic, const std::string& value) {
+    if (this->broker_ready && this->msg_proto.connected()) {
+        this->msg_proto.send_message(topic, value);
+        return;
+    }
+
+    if (this->pending_publishes.size() >= this->max_pending_publishes) {
+        this->pending_publishes.pop_front();
+    }
+    this->pending_publishes.push_back(std::make_pair(topic, value));
+}
+
+/*
+ * Drive the broker once its background begin has finished; flush buffered publishes on first connect
+ */
+void RF24Node::service_broker(void) {
+    if (!this->broker_ready) {
+        if (!this->broker_begin.valid()) {
+            if (steady_clock::now() >= this->broker_retry_at) {
+                this->broker_begin = std::async(std::launch::async, [this]() { this->msg_proto.begin(); });
+            }
+            return;
+        }
+        if (this->broker_begin.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+            return;
+        }
+
+        // begin() runs in the background; an exception (broker down) surfaces here, so retry later
+        try {
+            this->broker_begin.get();
+        } catch (const std::exception& e) {
+            logger.error(CAT_BROKER, "Broker begin failed: %s; retrying in 15 s\n", e.what());
+            this->broker_retry_at = steady_clock::now() + std::chrono::seconds(15);
+            return;
+        } catch (...) {
+            logger.error(CAT_BROKER, "Broker begin failed; retrying in 15 s\n");
+            this->broker_retry_at = steady_clock::now() + std::chrono::seconds(15);
+            return;
+        }
+        this->broker_ready = true;
+        this->startup.broker_begun = steady_clock::now();
+        logger.info(CAT_BROKER, "Broker begin finished after %lld ms\n", this->startup_ms(this->startup.broker_begun));
+
+        if (this->subscriptions_dirty) {
+            this->update_subscriptions();
+        }
+    }
+
+    this->msg_proto.loop();
+
+    if (!this->msg_proto.connected()) {
+        return;
+    }
+
+    if (this->startup.broker_connected == steady_clock::time_point()) {
+        this->startup.broker_connected = steady_clock::now();
+
+        // radio_ms|broker_begin_ms|broker_connected_ms|first_frame_ms|buffered
+        std::stringstream s_startup;
+        s_startup << this->startup_ms(this->startup.radio_ready) << "|" << this->startup_ms(this->startup.broker_begun) << "|" 
+            << this->startup_ms(this->startup.broker_connected) << "|" << this->startup_ms(this->startup.first_frame) << "|" 
+            << this->pending_publishes.size();
+        logger.info(CAT_GATEWAY, "Startup timings (ms): %s\n", s_startup.str().c_str());
+        this->pending_publishes.push_back(std::make_pair(this->generate_msg_proto_topic({ "stats", "startup" }), s_startup.str()));
+    }
+
+    while (!this->pending_publishes.empty()) {
+        auto &message = this->pending_publishes.front();
+        this->msg_proto.send_message(message.first, message.second);
+        this->pending_publishes.pop_front();
+    }
+}
+
+/*
+ * Milliseconds from begin() to a startup milestone; -1 if it has not happened
+ */
+long long RF24Node::startup_ms(steady_clock::time_point when) {
+    if (when == steady_clock::time_point()) {
+        return -1;
+    }
+    return std::chrono::duration_cast<std::chrono::milliseconds>(when - this->startup.started).count();
+}
+
 void RF24Node::loop(void) {
     this->network.update();
     while (this->network.available()) {
@@ -69,96 +174,857 @@ void RF24Node::loop(void) {
                 break;
         }
     }
-    this->msg_proto.loop();
+    for (auto &resend : this->shadow.due(steady_clock::now())) {
+        logger.info(CAT_GATEWAY, "Node 0%o, payload type %d, id %d still drifted; reconciling with '%s'\n", resend.node, resend.type, resend.id, resend.payload.c_str());
+        this->queue_command(resend.node, resend.type, std::move(resend.payload), 0);
+    }
+
+    this->pump_challenges();
+    this->service_radio();
+
+    if (steady_clock::now() - this->last_stats >= this->stats_interval) {
+        this->publish_stats();
+    }
+
+    if (this->sharding && steady_clock::now() - this->last_heartbeat >= this->heartbeat_interval) {
+        this->send_heartbeat();
+        if (this->shard.expire(steady_clock::now(), this->heartbeat_interval * 3)) {
+            this->update_subscriptions();
+        }
+    }
+
+    this->service_broker();
 }
 
+/*
+ * Write once to the radio and record the outcome against the destination's link
+ */
 bool RF24Node::write(RF24NetworkHeader& header, const void* message, size_t len) {
-    const auto max_retries = 1;
-    auto ok = false;
+    auto result = radio_write_result_t();
+    auto ok = this->network.write(header, message, len, result);
+    this->links.record(header.to_node, result);
+    return ok;
+}
 
-    auto retries = max_retries;
-    while (!ok && retries-- > 0) {
-        ok = this->network.write(header, message, len);
+/*
+ * Shortest payload accepted for a packet: the packed AVR layout where it differs from ours
+ */
+static size_t packed_size(uint8_t type, size_t expected) {
+    switch (type) {
+        case PKT_TIME:
+            return 0; /* Requests need not carry a payload */
+        case PKT_SWITCH:
+            return PKT_SWITCH_PACKED;
+        case PKT_RGB:
+            return PKT_RGB_PACKED;
+        case PKT_CHALLENGE:
+            return PKT_CHALLENGE_PACKED;
+        default:
+            return expected;
     }
-    return ok;
+}
+
+/*
+ * Zero everything past the payload and move packed AVR fields to their fixed offsets
+ */
+static void widen_frame(uint8_t type, wire_frame_t& frame, size_t len) {
+    memset(frame.raw + len, 0, sizeof(frame.raw) - len);
+
+    if (type == PKT_SWITCH && len == PKT_SWITCH_PACKED) {
+        memmove(frame.raw + offsetof(pkt_switch_t, timer), frame.raw + 11, sizeof(frame.sw.timer));
+        frame.sw.reserved = 0;
+    } else if (type == PKT_RGB && len == PKT_RGB_PACKED) {
+        memmove(frame.raw + offsetof(pkt_rgb_t, timer), frame.raw + 13, sizeof(frame.rgb.timer));
+        memset(frame.rgb.reserved, 0, sizeof(frame.rgb.reserved));
+    }
+}
+
+/*
+ * Move fixed-layout fields down to the packed AVR offsets; returns the packed length
+ */
+static size_t narrow_frame(uint8_t type, wire_frame_t& frame, size_t len) {
+    switch (type) {
+        case PKT_SWITCH:
+            if (len != sizeof(pkt_switch_t)) {
+                break;
+            }
+            memmove(frame.raw + 11, frame.raw + offsetof(pkt_switch_t, timer), sizeof(frame.sw.timer));
+            return PKT_SWITCH_PACKED;
+        case PKT_RGB:
+            if (len != sizeof(pkt_rgb_t)) {
+                break;
+            }
+            memmove(frame.raw + 13, frame.raw + offsetof(pkt_rgb_t, timer), sizeof(frame.rgb.timer));
+            return PKT_RGB_PACKED;
+        case PKT_CHALLENGE:
+            if (len != sizeof(pkt_challenge_t)) {
+                break;
+            }
+            return PKT_CHALLENGE_PACKED;
+    }
+    return len;
+}
+
+/*
+ * Read a frame, verify its trailer if signed, and widen short (packed) payloads to the fixed layout
+ */
+bool RF24Node::read_frame(RF24NetworkHeader& header, wire_frame_t& frame, size_t expected) {
+    auto len = this->network.read(header, frame.raw, sizeof(frame.raw));
+    this->frames_received++;
+
+    auto minimum = packed_size(header.type, expected);
+    auto is_signed = len >= minimum + sizeof(pkt_auth_t);
+    auto payload_len = is_signed ? len - sizeof(pkt_auth_t) : len;
+
+    if (payload_len < minimum || payload_len > expected) {
+        this->frames_malformed++;
+        logger.warn(CAT_RADIO, "Dropping frame type %d from node 0%o: %zu bytes, expected %zu to %zu\n", 
+            header.type, header.from_node, len, minimum, expected);
+        return false;
+    }
+
+    if (is_signed) {
+        if (!this->verify_frame(header, frame, payload_len)) {
+            return false;
+        }
+    } else if (this->auth_required.count(header.from_node)) {
+        this->auth_stats.unsigned_frames++;
+        logger.warn(CAT_AUTH, "Rejecting unsigned frame type %d from node 0%o\n", header.type, header.from_node);
+        return false;
+    }
+
+    // Remember which layout the node uses, so commands to it go out the same way
+    if (minimum != expected && header.type != PKT_TIME) {
+        if (payload_len < expected) {
+            this->packed_nodes.insert(header.from_node);
+        } else {
+            this->packed_nodes.erase(header.from_node);
+        }
+    }
+
+    widen_frame(header.type, frame, payload_len);
+    this->heard(header);
+    return true;
+}
+
+/*
+ * A frame from this node was read and verified: claim the node and deliver anything waiting for it
+ */
+void RF24Node::heard(RF24NetworkHeader& header) {
+    if (this->startup.first_frame == steady_clock::time_point()) {
+        this->startup.first_frame = steady_clock::now();
+        logger.info(CAT_RADIO, "First accepted frame after %lld ms\n", this->startup_ms(this->startup.first_frame));
+    }
+
+    if (this->sharding && this->shard.heard(header.from_node)) {
+        this->update_subscriptions();
+        this->send_heartbeat();
+    }
+
+    // The node just transmitted, so it is awake and listening for a moment
+    if (header.type != PKT_CHALLENGE) {
+        this->deliver_mailbox(header.from_node);
+    }
+}
+
+/*
+ * Check the trailer on an authenticated uplink frame, then its sequence against the node's replay window
+ */
+bool RF24Node::verify_frame(RF24NetworkHeader& header, wire_frame_t& frame, size_t expected) {
+    auto trailer = pkt_auth_t();
+    memcpy(&trailer, frame.raw + expected, sizeof(trailer));
+
+    // payload | sequence | node | type, all little-endian
+    uint8_t data[sizeof(frame.raw) + 7];
+    memcpy(data, frame.raw, expected);
+    auto n = expected;
+    for (auto i = 0; i < 4; i++) data[n++] = (trailer.sequence >> (8 * i)) & 0xFF;
+    data[n++] = header.from_node & 0xFF;
+    data[n++] = (header.from_node >> 8) & 0xFF;
+    data[n++] = header.type;
+
+    auto siphash = siphash24(data, n, &this->key[0]);
+    auto difference = uint8_t(0);
+    for (auto i = 0; i < 8; i++) {
+        difference |= trailer.hash[i] ^ ((siphash >> (8 * i)) & 0xFF);
+    }
+
+    // Compare every byte so timing does not reveal how much of the hash matched
+    if (difference != 0) {
+        this->auth_stats.bad_hash++;
+        logger.warn(CAT_AUTH, "Rejecting frame type %d from node 0%o: bad hash\n", header.type, header.from_node);
+        return false;
+    }
+
+    if (!this->replay_windows[header.from_node].accept(trailer.sequence)) {
+        this->auth_stats.replayed++;
+        logger.warn(CAT_AUTH, "Rejecting frame type %d from node 0%o: replayed sequence %u\n", header.type, header.from_node, trailer.sequence);
+        return false;
+    }
+
+    this->auth_stats.verified++;
+    return true;
+}
+
+/*
+ * Queue a frame for the outbound scheduler
+ */
+void RF24Node::send(RF24NetworkHeader& header, const void* message, size_t len, uint8_t priority) {
+    // Nodes that send the packed AVR layout read it too
+    wire_frame_t frame;
+    if (this->packed_nodes.count(header.to_node) && len <= sizeof(frame.raw)) {
+        memcpy(frame.raw, message, len);
+        len = narrow_frame(header.type, frame, len);
+        message = frame.raw;
+    }
+
+    auto dropped = scheduled_frame_t();
+    if (!this->scheduler.enqueue(priority, header.to_node, header.type, message, len, dropped)) {
+        return;
+    }
+
+    logger.warn(CAT_RADIO, "Outbound queue for priority %d full; dropped type %d for node 0%o\n", priority, dropped.type, dropped.node);
+
+    // Treat a dropped challenge as written and lost, so it times out and is retried as usual
+    if (dropped.type == PKT_CHALLENGE && dropped.payload.size() > offsetof(pkt_challenge_t, type)) {
+        this->challenge_written(dropped.node, dropped.payload[offsetof(pkt_challenge_t, type)]);
+    }
+}
+
+/*
+ * Put as many queued frames on the air as priority, retry spacing and the airtime budget allow
+ */
+void RF24Node::service_radio(void) {
+    auto frame = scheduled_frame_t();
+    while (this->scheduler.next(frame, steady_clock::now())) {
+        RF24NetworkHeader header(frame.node, frame.type);
+
+        // Time replies may have waited behind other traffic or the budget; stamp them as they go out
+        if (frame.type == PKT_TIME && frame.payload.size() >= sizeof(pkt_time_t)) {
+            auto payload = pkt_time_t { static_cast<uint32_t>(time(0)) };
+            memcpy(frame.payload.data(), &payload, sizeof(payload));
+        }
+
+        // Weak links get more attempts; each one goes back through the scheduler, spaced and charged to the budget
+        if (!this->write(header, frame.payload.data(), frame.payload.size())) {
+            auto attempts = this->links.attempts(frame.node);
+            if (frame.attempt + 1 < attempts) {
+                this->scheduler.retry(frame, steady_clock::now() + this->links.spacing(frame.node));
+                continue;
+            }
+            logger.debug(CAT_RADIO, "Write of type %d to node 0%o failed after %d attempts\n", frame.type, frame.node, frame.attempt + 1);
+        }
+
+        if (frame.type == PKT_CHALLENGE && frame.payload.size() > offsetof(pkt_challenge_t, type)) {
+            this->challenge_written(frame.node, frame.payload[offsetof(pkt_challenge_t, type)]);
+        }
+    }
+}
+
+/*
+ * Start the response timeout of the oldest challenge for this node and type still waiting to be written
+ */
+void RF24Node::challenge_written(uint16_t node, uint8_t type) {
+    for (auto &challenge : this->challenges_in_flight) {
+        if (challenge.node == node && challenge.type == type && challenge.sent_at == steady_clock::time_point()) {
+            challenge.sent_at = steady_clock::now();
+            return;
+        }
+    }
+}
+
+/*
+ * Publish gateway counters on <sep>sensornet<sep>stats<sep>CATEGORY
+ */
+void RF24Node::publish_stats(void) {
+    this->last_stats = steady_clock::now();
+
+    // priority|depth|sent|avg_wait_ms|max_wait_ms|dropped per class
+    std::stringstream s_value;
+    for (uint8_t priority = 0; priority < RADIO_PRIORITY_COUNT; priority++) {
+        auto &stats = this->scheduler.stats(priority);
+        auto avg_wait_us = stats.sent > 0 ? stats.total_wait_us / stats.sent : 0;
+        s_value << (priority > 0 ? ";" : "") << int(priority) << "|" << stats.depth << "|" << stats.sent 
+            << "|" << avg_wait_us / 1000.0 << "|" << stats.max_wait_us / 1000.0 << "|" << stats.dropped;
+    }
+    this->scheduler.reset_max_wait();
+
+    this->publish(this->generate_msg_proto_topic({ "stats", "scheduler" }), s_value.str());
+
+    // actuators|suppressed|reconciled
+    std::stringstream s_shadow;
+    s_shadow << this->shadow.size() << "|" << this->shadow.get_suppressed() << "|" << this->shadow.get_reconciled();
+    this->publish(this->generate_msg_proto_topic({ "stats", "shadow" }), s_shadow.str());
+
+    // received|malformed
+    std::stringstream s_frames;
+    s_frames << this->frames_received << "|" << this->frames_malformed;
+    this->publish(this->generate_msg_proto_topic({ "stats", "frames" }), s_frames.str());
+
+    // verified|bad_hash|replayed|unsigned
+    std::stringstream s_auth;
+    s_auth << this->auth_stats.verified << "|" << this->auth_stats.bad_hash << "|" 
+        << this->auth_stats.replayed << "|" << this->auth_stats.unsigned_frames;
+    this->publish(this->generate_msg_proto_topic({ "stats", "auth" }), s_auth.str());
+
+    // node|writes|acked|failed|success|avg_retries|attempts|repeater per node
+    std::stringstream s_links;
+    for (auto &entry : this->links.all()) {
+        auto &link = entry.second;
+        s_links << (s_links.tellp() > 0 ? ";" : "") << std::oct << entry.first << std::dec << "|" << link.writes << "|" 
+            << link.acked << "|" << link.failed << "|" << link.success << "|" << link.retries << "|" 
+            << int(this->links.attempts(entry.first)) << "|" << link.needs_repeater;
+    }
+    this->publish(this->generate_msg_proto_topic({ "stats", "links" }), s_links.str());
+
+    // node|count|avg_ms|max_ms|mailbox_count|mailbox_avg_ms|mailbox_max_ms per node
+    std::stringstream s_latency;
+    for (auto &entry : this->command_latency) {
+        auto &challenged = entry.second.challenged;
+        auto &mailbox = entry.second.mailbox;
+        s_latency << (s_latency.tellp() > 0 ? ";" : "") << std::oct << entry.first << std::dec << "|" 
+            << challenged.count << "|" << (challenged.count > 0 ? challenged.total_ms / challenged.count : 0) << "|" << challenged.max_ms << "|" 
+            << mailbox.count << "|" << (mailbox.count > 0 ? mailbox.total_ms / mailbox.count : 0) << "|" << mailbox.max_ms;
+    }
+    this->publish(this->generate_msg_proto_topic({ "stats", "latency" }), s_latency.str());
 }
 
 /**
  * Upon receiving a command via the C++/Python IPC topic, queue the message
  */
-void RF24Node::handle_receive_message(std::string subject, std::string body) {
-    if (this->debug) printf("Received '%s' via topic '%s' from MQTT\n", subject.c_str(), body.c_str());
+void RF24Node::handle_receive_message(const std::string& subject, std::string body) {
+    logger.debug(CAT_BROKER, "Received '%s' via topic '%s' from MQTT\n", subject.c_str(), body.c_str());
 
     auto elements = split(subject, this->topic_separator);
+    if (elements.size() > 3 && elements[2] == "gateway") {
+        this->handle_receive_heartbeat(elements[3], body);
+        return;
+    }
+
+    if (elements.size() > 4 && elements[3] == "group") {
+        this->handle_receive_group(elements, body);
+        return;
+    }
+
     uint16_t to_node = std::stoul("0" + elements[3], nullptr, 0);
     uint8_t type_command = std::stoi(elements[4], nullptr);
     uint8_t type = type_command % 64;
 
-    // Asking for sensor data is unsupported 
+    // Another gateway owns this node
+    if (this->sharding && !this->shard.handles(to_node)) {
+        return;
+    }
+
+    // Asking for sensor data is served from the in-memory history
     if (type_command < 64) {
+        this->handle_receive_history(to_node, type_command, body);
         return;
     }
-        
-    this->queued_payloads[to_node][type] = body;
 
-    if (this->debug) printf("Queuing: '%s' for node 0%o, payload type %d\n", body.c_str(), to_node, type);
+    if (this->command_needed(to_node, type, body)) {
+        this->queue_command(to_node, type, std::move(body), 0);
+    }
+}
+
+/**
+ * Upon receiving a group topic, either define the group or fan the command out to its targets
+ *
+ * Define: <sep>sensornet<sep>in<sep>group<sep>NAME with body "node:id,node:id,..."
+ * Command: <sep>sensornet<sep>in<sep>group<sep>NAME<sep>TYPE_COMMAND with the payload minus the id
+ */
+void RF24Node::handle_receive_group(const std::vector<std::string>& elements, const std::string& body) {
+    auto &name = elements[4];
+
+    if (elements.size() == 5) {
+        auto targets = std::vector<group_target_t>();
+        for (auto &target : split(body, ',')) {
+            auto parts = split(target, ':');
+            auto node = 0UL;
+            auto id = 0UL;
+            if (parts.size() != 2 || parts[0].empty() || !parse_number("0" + parts[0], node) || !parse_number(parts[1], id) ||
+                node > 0xFFFF || id > 0xFFFF) {
+                logger.debug(CAT_GATEWAY, "Ignoring malformed target '%s' in group '%s'\n", target.c_str(), name.c_str());
+                continue;
+            }
+            targets.push_back(group_target_t { static_cast<uint16_t>(node), static_cast<uint16_t>(id) });
+        }
+
+        logger.debug(CAT_GATEWAY, "Defining group '%s' with %zu targets\n", name.c_str(), targets.size());
+        this->groups[name] = targets;
+        return;
+    }
+
+    auto found = this->groups.find(name);
+    if (found == this->groups.end() || found->second.empty()) {
+        logger.debug(CAT_GATEWAY, "No targets defined for group '%s'\n", name.c_str());
+        return;
+    }
+
+    uint8_t type_command = std::stoi(elements[5], nullptr);
+    uint8_t type = type_command % 64;
+    if (type_command < 64) {
+        return;
+    }
+
+    // Only fan out to the targets this gateway is responsible for
+    auto targets = std::vector<group_target_t>();
+    for (auto &target : found->second) {
+        if (!this->sharding || this->shard.handles(target.node)) {
+            targets.push_back(target);
+        }
+    }
 
-    auto payload = pkt_challenge_t { 0, type };
-    RF24NetworkHeader header(to_node, PKT_CHALLENGE);
-    this->write(header, &payload, sizeof(payload));
+    if (targets.empty()) {
+        return;
+    }
+
+    // Each command gets its own job, so a re-run of the group does not mix with the last one
+    // Targets already in the requested state count as done
+    auto job = this->next_job++;
+    this->group_jobs[job] = group_job_t { name, steady_clock::now(), targets.size(), 0, 0 };
+    for (auto &target : targets) {
+        auto payload = std::to_string(target.id) + "|" + body;
+        if (this->command_needed(target.node, type, payload)) {
+            this->queue_command(target.node, type, std::move(payload), job);
+        } else {
+            this->finish_group_target(job, true);
+        }
+    }
+}
+
+/*
+ * Record the desired state in the shadow; false if the actuator already reports it
+ */
+bool RF24Node::command_needed(uint16_t node, uint8_t type, const std::string& payload) {
+    auto id = uint16_t(0);
+    auto state = std::string();
+    auto timer = uint32_t(0);
+    if (!ShadowStore::parse_command(type, payload, id, state, timer)) {
+        return true;
+    }
+
+    // A command still queued for this id may differ from the reported state, so it is replaced rather than suppressed
+    if (!this->shadow.request(node, type, id, state, payload, timer == 0, this->command_queued(node, type, id), steady_clock::now())) {
+        logger.debug(CAT_GATEWAY, "Node 0%o, payload type %d, id %d already reports '%s'; not sending\n", node, type, id, state.c_str());
+        return false;
+    }
+    return true;
+}
+
+/*
+ * Whether a command for this (node, type, id) is waiting for its challenge response
+ */
+bool RF24Node::command_queued(uint16_t node, uint8_t type, uint16_t id) const {
+    auto node_payloads = this->queued_payloads.find(node);
+    if (node_payloads == this->queued_payloads.end()) {
+        return false;
+    }
+
+    auto type_payloads = node_payloads->second.find(type);
+    if (type_payloads == node_payloads->second.end()) {
+        return false;
+    }
+
+    return std::any_of(type_payloads->second.begin(), type_payloads->second.end(), 
+        [id](const queued_payload_t& q) { return q.id == id; });
+}
+
+/*
+ * Record a reported actuator state; requeue the desired command if the actuator drifted from it
+ */
+void RF24Node::reconcile(uint16_t node, uint8_t type, uint16_t id, const std::string& state) {
+    // A command still queued for this id will correct the drift itself when the node is next challenged
+    auto payload = std::string();
+    if (this->shadow.report(node, type, id, state, this->command_queued(node, type, id), steady_clock::now(), payload)) {
+        logger.info(CAT_GATEWAY, "Node 0%o, payload type %d, id %d reports '%s'; reconciling with '%s'\n", node, type, id, state.c_str(), payload.c_str());
+        this->queue_command(node, type, std::move(payload), 0);
+    }
+}
+
+/*
+ * Upon receiving another gateway's heartbeat, record the nodes it has heard from
+ */
+void RF24Node::handle_receive_heartbeat(const std::string& gateway, const std::string& body) {
+    if (!this->sharding) {
+        return;
+    }
+
+    auto nodes = std::set<uint16_t>();
+    for (auto &node : split(body, ',')) {
+        if (!node.empty()) {
+            nodes.insert(std::stoul("0" + node, nullptr, 0));
+        }
+    }
+
+    this->shard.announce(gateway, nodes, steady_clock::now());
+    this->update_subscriptions();
+}
+
+/*
+ * Announce the nodes heard on this gateway's radio
+ */
+void RF24Node::send_heartbeat(void) {
+    std::stringstream s_value;
+    s_value << std::oct;
+    for (auto &node : this->shard.heard_nodes()) {
+        if (s_value.tellp() > 0) {
+            s_value << ",";
+        }
+        s_value << node;
+    }
+
+    this->last_heartbeat = steady_clock::now();
+    this->publish(this->generate_msg_proto_topic({ "gateway", this->gateway_id }), s_value.str());
+}
+
+/*
+ * Narrow command subscriptions to the nodes this gateway owns;
+ * the default gateway keeps the wildcard so unclaimed nodes are still served
+ */
+void RF24Node::update_subscriptions(void) {
+    // Subscriptions can't change underneath a broker begin still running in the background
+    if (this->broker_begin.valid() && !this->broker_ready) {
+        this->subscriptions_dirty = true;
+        return;
+    }
+    this->subscriptions_dirty = false;
+
+    auto desired = std::set<std::string>();
+    desired.insert(this->generate_msg_proto_topic({ "gateway", "#" }));
+    desired.insert(this->generate_msg_proto_topic({ "in", "group", "#" }));
+
+    if (this->shard.is_default()) {
+        desired.insert(this->generate_msg_proto_topic({ "in", "#" }));
+    } else {
+        for (auto node : this->shard.owned()) {
+            std::stringstream s_node;
+            s_node << std::oct << node;
+            desired.insert(this->generate_msg_proto_topic({ "in", s_node.str(), "#" }));
+        }
+    }
+
+    for (auto &topic : this->subscriptions) {
+        if (!desired.count(topic)) {
+            logger.debug(CAT_BROKER, "Unsubscribing from %s\n", topic.c_str());
+            this->msg_proto.remove_subscription(topic);
+        }
+    }
+    for (auto &topic : desired) {
+        if (!this->subscriptions.count(topic)) {
+            logger.debug(CAT_BROKER, "Subscribing to %s\n", topic.c_str());
+            this->msg_proto.add_subscription(topic);
+        }
+    }
+
+    this->subscriptions = desired;
+}
+
+/*
+ * Queue a command payload and schedule the challenge that will release it. A newer command
+ * for the same id replaces the queued one, and each (node, type) holds at most max_queued_commands.
+ */
+void RF24Node::queue_command(uint16_t node, uint8_t type, std::string payload, uint32_t job) {
+    logger.debug(CAT_GATEWAY, "Queuing: '%s' for node 0%o, payload type %d\n", payload.c_str(), node, type);
+
+    auto elements = split(payload, '|');
+    uint16_t id = !elements.empty() && !elements[0].empty() ? std::stoul(elements[0], nullptr, 0) : 0;
+    auto &payloads = this->queued_payloads[node][type];
+
+    auto queued = std::find_if(payloads.begin(), payloads.end(), 
+        [id](const queued_payload_t& q) { return q.id == id; });
+    if (queued != payloads.end()) {
+        logger.debug(CAT_GATEWAY, "Replacing queued '%s' for node 0%o, payload type %d\n", queued->payload.c_str(), node, type);
+        this->finish_group_target(queued->job, false);
+        queued->payload = std::move(payload);
+        queued->queued_at = steady_clock::now();
+        queued->job = job;
+    } else {
+        if (payloads.size() >= this->max_queued_commands) {
+            logger.warn(CAT_GATEWAY, "Command queue full for node 0%o, payload type %d; dropping '%s'\n", node, type, payloads.front().payload.c_str());
+            this->finish_group_target(payloads.front().job, false);
+            payloads.pop_front();
+        }
+        payloads.push_back(queued_payload_t { id, std::move(payload), steady_clock::now(), job });
+    }
+
+    // One challenge per queued payload, counting those waiting and those on the air
+    auto matches = [node, type](const pending_challenge_t& c) { return c.node == node && c.type == type; };
+    auto challenges = size_t(std::count_if(this->challenge_queue.begin(), this->challenge_queue.end(), matches) +
+        std::count_if(this->challenges_in_flight.begin(), this->challenges_in_flight.end(), matches));
+    if (challenges < payloads.size()) {
+        this->challenge_queue.push_back(pending_challenge_t { node, type, steady_clock::time_point(), 0, false });
+    }
+}
+
+/*
+ * Keep up to challenge_window challenges on the air; retry the ones that time out
+ */
+void RF24Node::pump_challenges(void) {
+    auto now = steady_clock::now();
+
+    for (auto it = this->challenges_in_flight.begin(); it != this->challenges_in_flight.end(); ) {
+        // Still held by the scheduler, or written too recently to have timed out
+        if (it->sent_at == steady_clock::time_point() || now - it->sent_at < this->challenge_timeout) {
+            ++it;
+            continue;
+        }
+
+        if (it->attempts < this->challenge_attempts) {
+            this->challenge_queue.push_front(*it);
+        } else {
+            // Give up the slot; the payload stays queued in case the node answers later
+            logger.debug(CAT_AUTH, "Challenge for node 0%o, payload type %d timed out\n", it->node, it->type);
+            auto &payloads = this->queued_payloads[it->node][it->type];
+            auto unaccounted = std::find_if(payloads.begin(), payloads.end(), 
+                [](const queued_payload_t& q) { return q.job != 0; });
+            if (unaccounted != payloads.end()) {
+                this->finish_group_target(unaccounted->job, false);
+                unaccounted->job = 0;
+            }
+        }
+        it = this->challenges_in_flight.erase(it);
+    }
+
+    while (!this->challenge_queue.empty() && this->challenges_in_flight.size() < this->challenge_window) {
+        auto pending = this->challenge_queue.front();
+        this->challenge_queue.pop_front();
+
+        auto payload = pkt_challenge_t { 0, pending.type };
+        RF24NetworkHeader header(pending.node, PKT_CHALLENGE);
+        this->send(header, &payload, sizeof(payload), PRIORITY_CHALLENGE);
+
+        // The timeout starts once service_radio actually writes it
+        pending.sent_at = steady_clock::time_point();
+        pending.attempts++;
+        pending.mailbox = false;
+        this->challenges_in_flight.push_back(pending);
+    }
+}
+
+/*
+ * Account for one target of a group command; publish the totals when the last one finishes
+ */
+void RF24Node::finish_group_target(uint32_t job, bool ok) {
+    auto found = this->group_jobs.find(job);
+    if (job == 0 || found == this->group_jobs.end()) {
+        return;
+    }
+
+    auto &progress = found->second;
+    if (ok) {
+        progress.done++;
+    } else {
+        progress.failed++;
+    }
+
+    if (progress.done + progress.failed < progress.total) {
+        return;
+    }
+
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(steady_clock::now() - progress.started);
+
+    std::stringstream s_value;
+    s_value << progress.done << "|" << progress.failed << "|" << elapsed.count();
+
+    auto topic = this->generate_msg_proto_topic({ "group", progress.name });
+    auto value = s_value.str();
+
+    logger.debug(CAT_GATEWAY, "Group Complete: %s:%s\n", topic.c_str(), value.c_str());
+    this->publish(topic, value);
+    this->group_jobs.erase(found);
 }
 
 /*
  * Upon receiving a header specifying a challenge response, store the challenge
  */
 void RF24Node::handle_receive_challenge(RF24NetworkHeader& header) {
-    if (this->debug) printf("Handling challenge request for node 0%o.\n", header.from_node);
+    logger.debug(CAT_AUTH, "Handling challenge request for node 0%o.\n", header.from_node);
 
     // Read the challenge request response
-    auto payload = pkt_challenge_t();
-    this->network.read(header, &payload, sizeof(payload));
+    wire_frame_t frame;
+    if (!this->read_frame(header, frame, sizeof(pkt_challenge_t))) {
+        return;
+    }
+    auto &payload = frame.challenge;
+
+    // Release the oldest matching slot in the window
+    auto mailbox = false;
+    for (auto it = this->challenges_in_flight.begin(); it != this->challenges_in_flight.end(); ++it) {
+        if (it->node == header.from_node && it->type == payload.type) {
+            mailbox = it->mailbox;
+            this->challenges_in_flight.erase(it);
+            break;
+        }
+    }
 
-    if (this->queued_payloads.find(header.from_node) == this->queued_payloads.end() ||
-        this->queued_payloads[header.from_node].find(payload.type) == this->queued_payloads[header.from_node].end()) {
-        if (this->debug) printf("No queued payload for for node 0%o of payload type %d.\n", header.from_node, payload.type);
+    auto node_payloads = this->queued_payloads.find(header.from_node);
+    if (node_payloads == this->queued_payloads.end() ||
+        node_payloads->second.find(payload.type) == node_payloads->second.end() ||
+        node_payloads->second[payload.type].empty()) {
+        logger.debug(CAT_AUTH, "No queued payload for for node 0%o of payload type %d.\n", header.from_node, payload.type);
         return;
     }
     
+    auto &payloads = node_payloads->second[payload.type];
+    auto queued_payload = std::move(payloads.front().payload);
+    auto queued_at = payloads.front().queued_at;
+    auto job = payloads.front().job;
+    this->shadow.sent(header.from_node, payload.type, payloads.front().id);
+    payloads.pop_front();
+
     switch (payload.type) {
         case PKT_SWITCH:
-            this->handle_send_switch(header.from_node, this->queued_payloads[header.from_node][payload.type], payload.challenge);
+            this->handle_send_switch(header.from_node, queued_payload, payload.challenge);
             break;
         case PKT_RGB:
-            this->handle_send_rgb(header.from_node, this->queued_payloads[header.from_node][payload.type], payload.challenge);
+            this->handle_send_rgb(header.from_node, queued_payload, payload.challenge);
             break;
     }
 
-    this->queued_payloads[header.from_node].erase(payload.type);
+    this->finish_group_target(job, true);
+
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(steady_clock::now() - queued_at).count();
+    auto &latency = mailbox ? this->command_latency[header.from_node].mailbox : this->command_latency[header.from_node].challenged;
+    latency.count++;
+    latency.total_ms += elapsed;
+    latency.max_ms = std::max<uint64_t>(latency.max_ms, elapsed);
+
+    // Anything else waiting can go while the node is still awake
+    this->deliver_mailbox(header.from_node);
+}
+
+/*
+ * Challenge a node for its queued commands right after hearing from it,
+ * while a sleepy node still has its receiver on
+ */
+void RF24Node::deliver_mailbox(uint16_t node) {
+    auto node_payloads = this->queued_payloads.find(node);
+    if (node_payloads == this->queued_payloads.end()) {
+        return;
+    }
+
+    auto now = steady_clock::now();
+    for (auto &type_payloads : node_payloads->second) {
+        if (type_payloads.second.empty()) {
+            continue;
+        }
+        auto type = type_payloads.first;
+
+        // A fresh challenge is already on its way
+        auto in_flight = std::find_if(this->challenges_in_flight.begin(), this->challenges_in_flight.end(), 
+            [node, type](const pending_challenge_t& c) { return c.node == node && c.type == type; });
+        // One still waiting in the scheduler is moved up to command priority, so it goes out while the node listens
+        if (in_flight != this->challenges_in_flight.end() && in_flight->sent_at == steady_clock::time_point()) {
+            if (this->scheduler.promote(node, PKT_CHALLENGE, PRIORITY_COMMAND) > 0) {
+                logger.debug(CAT_AUTH, "Promoted waiting challenge for node 0%o to command priority\n", node);
+            }
+            in_flight->mailbox = true;
+            continue;
+        }
+        if (in_flight != this->challenges_in_flight.end() && now - in_flight->sent_at < this->challenge_timeout) {
+            continue;
+        }
+
+        if (in_flight == this->challenges_in_flight.end()) {
+            // Take over a challenge still waiting for the window
+            auto queued = std::find_if(this->challenge_queue.begin(), this->challenge_queue.end(), 
+                [node, type](const pending_challenge_t& c) { return c.node == node && c.type == type; });
+            if (queued != this->challenge_queue.end()) {
+                this->challenge_queue.erase(queued);
+            }
+            this->challenges_in_flight.push_back(pending_challenge_t { node, type, steady_clock::time_point(), 0, true });
+            in_flight = this->challenges_in_flight.end() - 1;
+        }
+
+        in_flight->sent_at = steady_clock::time_point();
+        in_flight->attempts++;
+        in_flight->mailbox = true;
+
+        logger.debug(CAT_AUTH, "Mailbox challenge for node 0%o, payload type %d\n", node, type);
+        auto payload = pkt_challenge_t { 0, type };
+        RF24NetworkHeader header(node, PKT_CHALLENGE);
+        this->send(header, &payload, sizeof(payload), PRIORITY_COMMAND);
+    }
+
+    this->service_radio();
 }
 
 /*
  * Upon receiving a header specifying a timesync request, send the time to the node
  */
 void RF24Node::handle_receive_timesync(RF24NetworkHeader& header) {
-    if (this->debug) printf("Handling timesync request for node 0%o.\n", header.from_node);
+    logger.debug(CAT_RADIO, "Handling timesync request for node 0%o.\n", header.from_node);
 
-    // Read in the packet; not used
-    this->network.read(header, nullptr, 0);
+    // Read in the packet; only checked, not used
+    wire_frame_t frame;
+    if (!this->read_frame(header, frame, sizeof(pkt_time_t))) {
+        return;
+    }
 
-    // Set the current timestamp 
-    auto payload = pkt_time_t { time(0) };
+    // Set the current timestamp; service_radio stamps it again when it is actually written
+    auto payload = pkt_time_t { static_cast<uint32_t>(time(0)) };
 
     // Send the packet (timestamp) to the desired node
     RF24NetworkHeader new_header(header.from_node, PKT_TIME);
-    this->write(new_header, &payload, sizeof(payload));
+    this->send(new_header, &payload, sizeof(payload), PRIORITY_TIMESYNC);
+}
+
+/*
+ * Upon receiving a history query ("id|resolution"), publish the buckets held in memory
+ */
+void RF24Node::handle_receive_history(uint16_t node, uint8_t type, const std::string& body) {
+    auto elements = split(body, '|');
+    auto id = 0UL;
+    auto resolution = static_cast<unsigned long>(HISTORY_RESOLUTIONS[0]);
+    if (elements.empty() || !parse_number(elements[0], id) || id > 0xFFFF ||
+        (elements.size() > 1 && !parse_number(elements[1], resolution))) {
+        logger.debug(CAT_BROKER, "Ignoring malformed history query '%s' for node 0%o, payload type %d\n", body.c_str(), node, type);
+        return;
+    }
+    auto buckets = this->history.query(node, type, id, resolution, time(0));
+
+    std::stringstream s_value;
+    s_value << id << "|" << resolution;
+    for (auto &b : buckets) {
+        s_value << ";" << b.start << "|" << b.min << "|" << b.max << "|" << b.mean() << "|" << b.count;
+    }
+
+    auto topic = this->generate_msg_proto_subject("history", node, type);
+    auto value = s_value.str();
+
+    logger.debug(CAT_BROKER, "Publishing History: %s:%s\n", topic.c_str(), value.c_str());
+    this->publish(topic, value);
+}
+
+/*
+ * Add a reading to the history and publish any buckets it closed
+ */
+void RF24Node::record_history(RF24NetworkHeader& header, uint16_t id, double value) {
+    auto closed = this->history.record(header.from_node, header.type, id, value, time(0));
+    for (auto &summary : closed) {
+        std::stringstream s_value;
+        s_value << summary.id << "|" << summary.resolution << "|" << summary.bucket.start << "|" 
+            << summary.bucket.min << "|" << summary.bucket.max << "|" << summary.bucket.mean() << "|" << summary.bucket.count;
+
+        std::stringstream s_node;
+        s_node << std::oct << summary.node;
+        auto topic = this->generate_msg_proto_topic({ "summary", std::to_string(summary.resolution), s_node.str(), std::to_string(summary.type) });
+        auto value = s_value.str();
+
+        logger.debug(CAT_BROKER, "Publishing Summary: %s:%s\n", topic.c_str(), value.c_str());
+        this->publish(topic, value);
+    }
 }
 
 /*
  * Publish temps on MQTT 
  */
 void RF24Node::handle_receive_temp(RF24NetworkHeader& header) {
-    auto payload = pkt_temp_t();
-    this->network.read(header, &payload, sizeof(payload));
+    wire_frame_t frame;
+    if (!this->read_frame(header, frame, sizeof(pkt_temp_t))) {
+        return;
+    }
+    auto &payload = frame.temp;
 
     std::stringstream s_value;
     s_value << payload.id << "|" << (double)(payload.temp / 10.0);
@@ -166,16 +1032,21 @@ void RF24Node::handle_receive_temp(RF24NetworkHeader& header) {
     auto topic = this->generate_msg_proto_subject(header);
     auto value = s_value.str();
 
-    if (this->debug) printf("Republishing Temp: %s:%s\n", topic.c_str(), value.c_str());
-    this->msg_proto.send_message(topic, value);
+    logger.debug(CAT_RADIO, "Republishing Temp: %s:%s\n", topic.c_str(), value.c_str());
+    this->publish(topic, value);
+
+    this->record_history(header, payload.id, payload.temp / 10.0);
 }
 
 /*
  * Publish humidity on MQTT 
  */
 void RF24Node::handle_receive_humidity(RF24NetworkHeader& header) {
-    auto payload = pkt_humid_t();
-    this->network.read(header, &payload, sizeof(payload));
+    wire_frame_t frame;
+    if (!this->read_frame(header, frame, sizeof(pkt_humid_t))) {
+        return;
+    }
+    auto &payload = frame.humid;
 
     std::stringstream s_value;
     s_value << payload.id << "|" << ((double)(payload.humidity / 10.0));
@@ -183,33 +1054,41 @@ void RF24Node::handle_receive_humidity(RF24NetworkHeader& header) {
     auto topic = this->generate_msg_proto_subject(header);
     auto value = s_value.str();
 
-    if (this->debug) printf("Republishing Humidity: %s:%s\n", topic.c_str(), value.c_str());
-    this->msg_proto.send_message(topic, value);
+    logger.debug(CAT_RADIO, "Republishing Humidity: %s:%s\n", topic.c_str(), value.c_str());
+    this->publish(topic, value);
+
+    this->record_history(header, payload.id, payload.humidity / 10.0);
 }
 
 /*
  * Publish power on MQTT 
  */
 void RF24Node::handle_receive_power(RF24NetworkHeader& header) {
-    auto payload = pkt_power_t();
-    this->network.read(header, &payload, sizeof(payload));
+    wire_frame_t frame;
+    if (!this->read_frame(header, frame, sizeof(pkt_power_t))) {
+        return;
+    }
+    auto &payload = frame.power;
 
     std::stringstream s_value;
-    s_value << payload.battery << "|" << payload.solar << "|" << payload.vcc << "|" << payload.vs << "|" << payload.id;
+    s_value << int(payload.battery) << "|" << int(payload.solar) << "|" << payload.vcc << "|" << payload.vs << "|" << payload.id;
 
     auto topic = this->generate_msg_proto_subject(header);
     auto value = s_value.str();
 
-    if (this->debug) printf("Republishing Power: %s:%s\n", topic.c_str(), value.c_str());
-    this->msg_proto.send_message(topic, value);
+    logger.debug(CAT_RADIO, "Republishing Power: %s:%s\n", topic.c_str(), value.c_str());
+    this->publish(topic, value);
 }
 
 /*
  * Publish moisture on MQTT 
  */
 void RF24Node::handle_receive_moisture(RF24NetworkHeader& header) {
-    auto payload = pkt_moisture_t();
-    this->network.read(header, &payload, sizeof(payload));
+    wire_frame_t frame;
+    if (!this->read_frame(header, frame, sizeof(pkt_moisture_t))) {
+        return;
+    }
+    auto &payload = frame.moisture;
 
     std::stringstream s_value;
     s_value << payload.id << "|" << payload.moisture;
@@ -217,16 +1096,21 @@ void RF24Node::handle_receive_moisture(RF24NetworkHeader& header) {
     auto topic = this->generate_msg_proto_subject(header);
     auto value = s_value.str();
 
-    if (this->debug) printf("Republishing Moisture: %s:%s\n", topic.c_str(), value.c_str());
-    this->msg_proto.send_message(topic, value);
+    logger.debug(CAT_RADIO, "Republishing Moisture: %s:%s\n", topic.c_str(), value.c_str());
+    this->publish(topic, value);
+
+    this->record_history(header, payload.id, payload.moisture);
 }
 
 /*
  * Publish energy on MQTT 
  */
 void RF24Node::handle_receive_energy(RF24NetworkHeader& header) {
-    auto payload = pkt_energy_t();
-    this->network.read(header, &payload, sizeof(payload));
+    wire_frame_t frame;
+    if (!this->read_frame(header, frame, sizeof(pkt_energy_t))) {
+        return;
+    }
+    auto &payload = frame.energy;
 
     std::stringstream s_value;
     s_value << payload.id << "|" << payload.energy;
@@ -234,48 +1118,61 @@ void RF24Node::handle_receive_energy(RF24NetworkHeader& header) {
     auto topic = this->generate_msg_proto_subject(header);
     auto value = s_value.str();
 
-    if (this->debug) printf("Republishing Energy: %s:%s\n", topic.c_str(), value.c_str());
-    this->msg_proto.send_message(topic, value);
+    logger.debug(CAT_RADIO, "Republishing Energy: %s:%s\n", topic.c_str(), value.c_str());
+    this->publish(topic, value);
+
+    this->record_history(header, payload.id, payload.energy);
 }
 
 /*
  * Publish rgb on MQTT 
  */
 void RF24Node::handle_receive_rgb(RF24NetworkHeader& header) {
-    auto payload = pkt_rgb_t();
-    this->network.read(header, &payload, sizeof(payload));
+    wire_frame_t frame;
+    if (!this->read_frame(header, frame, sizeof(pkt_rgb_t))) {
+        return;
+    }
+    auto &payload = frame.rgb;
 
     std::stringstream s_value;
-    s_value << payload.id << "|" << payload.rgb[0] << "|" << payload.rgb[1] 
-        << "|" << payload.rgb[2] << "|" << payload.timer;
+    s_value << payload.id << "|" << int(payload.rgb[0]) << "|" << int(payload.rgb[1]) 
+        << "|" << int(payload.rgb[2]) << "|" << payload.timer;
 
     auto topic = this->generate_msg_proto_subject(header);
     auto value = s_value.str();
 
-    if (this->debug) printf("Republishing RGB: %s:%s\n", topic.c_str(), value.c_str());
-    this->msg_proto.send_message(topic, value);
+    logger.debug(CAT_RADIO, "Republishing RGB: %s:%s\n", topic.c_str(), value.c_str());
+    this->publish(topic, value);
+
+    auto state = std::to_string(int(payload.rgb[0])) + "|" + std::to_string(int(payload.rgb[1])) + "|" + std::to_string(int(payload.rgb[2]));
+    this->reconcile(header.from_node, PKT_RGB, payload.id, state);
 }
 
 /*
  * Publish switch on MQTT 
  */
 void RF24Node::handle_receive_switch(RF24NetworkHeader& header) {
-    auto payload = pkt_switch_t();
-    this->network.read(header, &payload, sizeof(payload));
+    wire_frame_t frame;
+    if (!this->read_frame(header, frame, sizeof(pkt_switch_t))) {
+        return;
+    }
+    auto &payload = frame.sw;
 
     std::stringstream s_value;
-    s_value << payload.id << "|" << payload.state << "|" << payload.timer;
+    s_value << payload.id << "|" << int(payload.state) << "|" << payload.timer;
 
     auto topic = this->generate_msg_proto_subject(header);
     auto value = s_value.str();
 
-    if (this->debug) printf("Republishing Switch: %s:%s\n", topic.c_str(), value.c_str());
-    this->msg_proto.send_message(topic, value);
+    logger.debug(CAT_RADIO, "Republishing Switch: %s:%s\n", topic.c_str(), value.c_str());
+    this->publish(topic, value);
+
+    this->reconcile(header.from_node, PKT_SWITCH, payload.id, payload.state ? "1" : "0");
 }
 
-void RF24Node::handle_send_rgb(uint16_t node, std::string queued_payload, time_t challenge) {
+void RF24Node::handle_send_rgb(uint16_t node, const std::string& queued_payload, time_t challenge) {
     auto siphash = this->generate_siphash(node, challenge);
-    auto elements = split(queued_payload.c_str(), '|');
+    auto elements = split(queued_payload, '|');
 
     auto payload = pkt_rgb_t();
     payload.id = std::stoi(elements[0], nullptr, 0);
@@ -285,22 +1182,20 @@ void RF24Node::handle_send_rgb(uint16_t node, std::string queued_payload, time_t
     payload.timer = std::stoi(elements[4], nullptr, 0);
     std::copy(siphash.begin(), siphash.end(), payload.hash);
 
-    if (this->debug) {
-        printf("Republishing RGB Command: 0%o:%s\n", node, queued_payload.c_str());
-        printf("-- payload: %d, (%d, %d, %d), %d\n", payload.id, payload.rgb[0], payload.rgb[1], payload.rgb[2], payload.timer);
-        printf("-- using siphashed (%d, %d, %d, %d, %d, %d, %d, %d) challenge %lu\n",
+    logger.debug(CAT_AUTH, "Republishing RGB Command: 0%o:%s\n", node, queued_payload.c_str());
+    logger.debug(CAT_AUTH, "-- payload: %d, (%d, %d, %d), %d\n", payload.id, payload.rgb[0], payload.rgb[1], payload.rgb[2], payload.timer);
+    logger.debug(CAT_AUTH, "-- using siphashed (%d, %d, %d, %d, %d, %d, %d, %d) challenge %lu\n",
         payload.hash[0], payload.hash[1], payload.hash[2], payload.hash[3], payload.hash[4],
         payload.hash[5], payload.hash[6], payload.hash[7], challenge);
-    }
 
     // Send a challenge request to the appropriate node
     RF24NetworkHeader header(node, PKT_SWITCH);
-    this->write(header, &payload, sizeof(payload));
+    this->send(header, &payload, sizeof(payload), PRIORITY_COMMAND);
 }
 
-void RF24Node::handle_send_switch(uint16_t node, std::string queued_payload, time_t challenge) {
+void RF24Node::handle_send_switch(uint16_t node, const std::string& queued_payload, time_t challenge) {
     auto siphash = this->generate_siphash(node, challenge);
-    auto elements = split(queued_payload.c_str(), '|');
+    auto elements = split(queued_payload, '|');
 
     auto payload = pkt_switch_t();
     payload.id = std::stoi(elements[0], nullptr, 0);
@@ -309,32 +1204,44 @@ void RF24Node::handle_send_switch(uint16_t node, std::string queued_payload, tim
     std::copy(siphash.begin(), siphash.end(), payload.hash);
 
 
-    if (this->debug) {
-        printf("Republishing Switch Command: 0%o:%s\n", node, queued_payload.c_str());
-        printf("-- payload: %d, %d, %d\n", payload.id, payload.state, payload.timer);
-        printf("-- using siphashed (%d, %d, %d, %d, %d, %d, %d, %d) challenge %lu\n",
+    logger.debug(CAT_AUTH, "Republishing Switch Command: 0%o:%s\n", node, queued_payload.c_str());
+    logger.debug(CAT_AUTH, "-- payload: %d, %d, %d\n", payload.id, payload.state, payload.timer);
+    logger.debug(CAT_AUTH, "-- using siphashed (%d, %d, %d, %d, %d, %d, %d, %d) challenge %lu\n",
         payload.hash[0], payload.hash[1], payload.hash[2], payload.hash[3], payload.hash[4],
         payload.hash[5], payload.hash[6], payload.hash[7], challenge);
-    }
 
     // Send a challenge request to the appropriate node
     RF24NetworkHeader header(node, PKT_SWITCH);
-    this->write(header, &payload, sizeof(payload));
+    this->send(header, &payload, sizeof(payload), PRIORITY_COMMAND);
 }
 
 std::string RF24Node::generate_msg_proto_subject(RF24NetworkHeader& header) {
-    char from_node_oct[] = { 0, 0, 0, 0, 0 };
-    sprintf(from_node_oct, "%o", header.from_node);
+    return this->generate_msg_proto_subject("out", header.from_node, header.type);
+}
+
+std::string RF24Node::generate_msg_proto_subject(const std::string& direction, uint16_t node, uint8_t type) {
+    char from_node_oct[] = { 0, 0, 0, 0, 0, 0, 0 };
+    sprintf(from_node_oct, "%o", node);
 
     std::stringstream s_topic;
     s_topic << this->topic_separator
             << "sensornet" 
             << this->topic_separator
-            << "out" 
+            << direction 
             << this->topic_separator
             << from_node_oct 
             << this->topic_separator
-            << std::to_string(header.type);
+            << std::to_string(type);
+
+    return s_topic.str();
+}
+
+std::string RF24Node::generate_msg_proto_topic(const std::vector<std::string>& levels) {
+    std::stringstream s_topic;
+    s_topic << this->topic_separator << "sensornet";
+    for (auto &level : levels) {
+        s_topic << this->topic_separator << level;
+    }
 
     return s_topic.str();
 }
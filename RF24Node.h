@@ -1,11 +1,22 @@
 #pragma once
 
+#include <algorithm>
+#include <future>
+#include <set>
+#include <unordered_set>
 #include <string>
 
 #include "RF24Network/RF24Network.h"
 #include "IMessageProtocol.h"
 #include "IRadioNetwork.h"
 #include "RF24Node_types.h"
+#include "SensorHistory.h"
+#include "ShardTable.h"
+#include "RadioScheduler.h"
+#include "Logger.h"
+#include "ShadowStore.h"
+#include "ReplayWindow.h"
+#include "LinkStats.h"
 
 class IMessageProtocol;
 class IRadioNetwork;
@@ -13,17 +24,65 @@ class IRadioNetwork;
 class RF24Node {
     protected:
         payload_map queued_payloads;
+        SensorHistory history;
 
         IMessageProtocol& msg_proto;
         IRadioNetwork& network;
 
-        bool debug;
         std::vector<char> key;
         char topic_separator;
 
+        group_map groups;
+        std::unordered_map<uint32_t /* job */, group_job_t> group_jobs;
+        uint32_t next_job;
+        std::deque<pending_challenge_t> challenge_queue;
+        std::deque<pending_challenge_t> challenges_in_flight;
+        size_t challenge_window;
+        std::chrono::milliseconds challenge_timeout;
+        uint8_t challenge_attempts;
+        size_t max_queued_commands;
+
+        bool sharding;
+        std::string gateway_id;
+        ShardTable shard;
+        std::set<std::string> subscriptions;
+        steady_clock::time_point last_heartbeat;
+        std::chrono::seconds heartbeat_interval;
+
+        RadioScheduler scheduler;
+        LinkStats links;
+        ShadowStore shadow;
+        std::unordered_map<uint16_t, command_latency_t> command_latency;
+        steady_clock::time_point last_stats;
+        std::chrono::seconds stats_interval;
+        uint64_t frames_received;
+        uint64_t frames_malformed;
+
+        std::unordered_set<uint16_t> auth_required;
+        std::unordered_set<uint16_t> packed_nodes; /* Nodes last heard using the packed AVR layout */
+        std::unordered_map<uint16_t, ReplayWindow> replay_windows;
+        auth_stats_t auth_stats;
+
+        std::future<void> broker_begin;
+        steady_clock::time_point broker_retry_at; /* Run begin() again once this passes, after it threw */
+        bool broker_ready;
+        bool subscriptions_dirty;
+        std::deque<std::pair<std::string, std::string>> pending_publishes;
+        size_t max_pending_publishes;
+        startup_timings_t startup;
+
         bool write(RF24NetworkHeader& header, const void* message, size_t len);
+        bool read_frame(RF24NetworkHeader& header, wire_frame_t& frame, size_t expected);
+        void heard(RF24NetworkHeader& header);
+        bool verify_frame(RF24NetworkHeader& header, wire_frame_t& frame, size_t expected);
+        void send(RF24NetworkHeader& header, const void* message, size_t len, uint8_t priority);
+        void service_radio(void);
+        void publish_stats(void);
+        void publish(const std::string& topic, const std::string& value);
+        void service_broker(void);
+        long long startup_ms(steady_clock::time_point when);
 
-        void handle_receive_message(std::string subject, std::string body);
+        void handle_receive_message(const std::string& subject, std::string body);
         void handle_receive_temp(RF24NetworkHeader& header);
         void handle_receive_humidity(RF24NetworkHeader& header);
         void handle_receive_power(RF24NetworkHeader& header);
@@ -33,11 +92,29 @@ class RF24Node {
         void handle_receive_moisture(RF24NetworkHeader& header);
         void handle_receive_challenge(RF24NetworkHeader& header);
         void handle_receive_timesync(RF24NetworkHeader& header);
-        void handle_send_switch(uint16_t node, std::string payload, time_t challenge);
-        void handle_send_rgb(uint16_t node, std::string payload, time_t challenge);
+        void handle_receive_history(uint16_t node, uint8_t type, const std::string& body);
+        void handle_receive_group(const std::vector<std::string>& elements, const std::string& body);
+        void handle_receive_heartbeat(const std::string& gateway, const std::string& body);
+        void record_history(RF24NetworkHeader& header, uint16_t id, double value);
+        void handle_send_switch(uint16_t node, const std::string& payload, time_t challenge);
+        void handle_send_rgb(uint16_t node, const std::string& payload, time_t challenge);
+
+        bool command_needed(uint16_t node, uint8_t type, const std::string& payload);
+        bool command_queued(uint16_t node, uint8_t type, uint16_t id) const;
+        void reconcile(uint16_t node, uint8_t type, uint16_t id, const std::string& state);
+        void queue_command(uint16_t node, uint8_t type, std::string payload, uint32_t job);
+        void pump_challenges(void);
+        void deliver_mailbox(uint16_t node);
+        void challenge_written(uint16_t node, uint8_t type);
+        void finish_group_target(uint32_t job, bool ok);
+
+        void send_heartbeat(void);
+        void update_subscriptions(void);
 
         std::vector<uint8_t> generate_siphash(uint16_t node, time_t challenge);
         std::string generate_msg_proto_subject(RF24NetworkHeader& header);
+        std::string generate_msg_proto_subject(const std::string& direction, uint16_t node, uint8_t type);
+        std::string generate_msg_proto_topic(const std::vector<std::string>& levels);
 
 
     public:
@@ -48,10 +125,29 @@ class RF24Node {
         void loop(void);
 
         void set_debug(bool _debug) {
-            this->debug = _debug;
+            logger.set_level(_debug ? LEVEL_DEBUG : LEVEL_INFO);
         }
 
         void set_topic_separator(char s) {
             this->topic_separator = s;
         }
+
+        void set_challenge_window(size_t window) {
+            // A window of 0 would never send a challenge
+            this->challenge_window = std::max<size_t>(window, 1);
+        }
+
+        void set_airtime_budget(uint32_t bitrate, uint32_t budget_us) {
+            this->scheduler.set_airtime_budget(bitrate, budget_us);
+        }
+
+        void require_auth(uint16_t node) {
+            this->auth_required.insert(node);
+        }
+
+        void set_gateway_id(std::string id) {
+            this->sharding = true;
+            this->gateway_id = id;
+            this->shard.set_self(id);
+        }
 };
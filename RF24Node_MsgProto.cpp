@@ -10,6 +10,7 @@
 #include "RF24NetworkWrapper.h"
 #include "RF24Node_types.h"
 #include "RF24Node.h"
+#include "Logger.h"
 
 /*
  * Main Program
@@ -38,6 +39,13 @@ int main(int argc, char *argv[]) {
         0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f
     });
 
+    size_t challenge_window = 8;
+    auto gateway_id = "";
+    uint32_t airtime_budget = 0;
+    auto log_file = "";
+    auto log_syslog = false;
+    auto auth_nodes = std::vector<std::string>();
+
     auto debug = false;
 
     static struct option long_options[] = {
@@ -56,6 +64,12 @@ int main(int argc, char *argv[]) {
       {"tls_key_file", required_argument, nullptr},
       {"tls_insecure_mode", no_argument, nullptr},
       {"amqp_connstr", required_argument, nullptr},
+      {"challenge_window", required_argument, nullptr},
+      {"gateway_id", required_argument, nullptr},
+      {"airtime_budget", required_argument, nullptr},
+      {"log_file", required_argument, nullptr},
+      {"syslog", no_argument, nullptr},
+      {"auth_nodes", required_argument, nullptr},
       {nullptr, 0, nullptr, 0}
     };
 
@@ -86,6 +100,22 @@ int main(int argc, char *argv[]) {
                     tls_key_file = optarg;
                 } else if (option == "tls_insecure_mode") {
                     tls_insecure_mode = true;
+                } else if (option == "challenge_window") {
+                    challenge_window = std::stoul(optarg, nullptr, 0);
+                    if (challenge_window < 1) {
+                        fprintf(stderr, "--challenge_window must be at least 1\n");
+                        exit(EXIT_FAILURE);
+                    }
+                } else if (option == "gateway_id") {
+                    gateway_id = optarg;
+                } else if (option == "airtime_budget") {
+                    airtime_budget = std::stoul(optarg, nullptr, 0);
+                } else if (option == "log_file") {
+                    log_file = optarg;
+                } else if (option == "syslog") {
+                    log_syslog = true;
+                } else if (option == "auth_nodes") {
+                    auth_nodes = split(optarg, ',');
                 }
                 break;
             case 'n' : 
@@ -121,6 +151,15 @@ int main(int argc, char *argv[]) {
         }
     }
 
+    if (log_syslog) {
+        logger.open_syslog();
+    } else if (strlen(log_file) > 0 && !logger.open_file(log_file)) {
+        fprintf(stderr, "Unable to open log file '%s'\n", log_file);
+        exit(EXIT_FAILURE);
+    }
+    logger.set_level(debug ? LEVEL_DEBUG : LEVEL_INFO);
+    logger.start();
+
     auto network = RF24NetworkWrapper(channel, node_address, palevel, datarate);
     std::unique_ptr<IMessageProtocol> msgproto;
     if (strcmp(msgproto_type, "AMQP") == 0) {
@@ -132,6 +171,14 @@ int main(int argc, char *argv[]) {
     auto node = RF24Node(network, *msgproto, key);
     node.set_debug(debug);
     node.set_topic_separator(msgproto_sep);
+    node.set_challenge_window(challenge_window);
+    node.set_airtime_budget(datarate == RF24_2MBPS ? 2000000 : datarate == RF24_1MBPS ? 1000000 : 250000, airtime_budget);
+    for (auto &auth_node : auth_nodes) {
+        node.require_auth(std::stoul("0" + auth_node, nullptr, 0));
+    }
+    if (strlen(gateway_id) > 0) {
+        node.set_gateway_id(gateway_id);
+    }
 
     node.begin();
     while(true) {
@@ -2,12 +2,73 @@
 
 #include <string>
 #include <stdint.h>
+#include <cstddef>
 #include <ctime>
+#include <chrono>
+#include <deque>
+#include <vector>
 #include <unordered_map>
 
-typedef std::unordered_map<uint8_t /* message_type */, std::string /* payload */> typepayload_map;
+typedef std::chrono::steady_clock steady_clock;
+
+/* Milestones from RF24Node::begin(); a default time_point means not reached yet */
+struct startup_timings_t {
+    steady_clock::time_point started;
+    steady_clock::time_point radio_ready;
+    steady_clock::time_point broker_begun;
+    steady_clock::time_point broker_connected;
+    steady_clock::time_point first_frame; /* First frame to pass read_frame */
+};
+
+/* A command payload waiting for its challenge response; only the latest per id is kept */
+struct queued_payload_t {
+    uint16_t id;
+    std::string payload;
+    steady_clock::time_point queued_at;
+    uint32_t job; /* Group job it counts towards; 0 for single commands or once accounted for */
+};
+
+typedef std::unordered_map<uint8_t /* message_type */, std::deque<queued_payload_t> /* payloads, oldest first */> typepayload_map;
 typedef std::unordered_map<uint16_t /* node_address */, typepayload_map> payload_map;
 
+/* A single member of a group/scene */
+struct group_target_t {
+    uint16_t node;
+    uint16_t id;
+};
+typedef std::unordered_map<std::string /* group name */, std::vector<group_target_t>> group_map;
+
+/* A challenge waiting for (or awaiting the response to) its turn on the air */
+struct pending_challenge_t {
+    uint16_t node;
+    uint8_t type;
+    steady_clock::time_point sent_at; /* When written to the radio; default while the scheduler holds it */
+    uint8_t attempts;
+    bool mailbox; /* Sent because the node was just heard awake */
+};
+
+/* Time from queuing a command to sending it signed */
+struct latency_figures_t {
+    uint64_t count;
+    uint64_t total_ms;
+    uint64_t max_ms;
+};
+
+/* Command latency per node, split by how the challenge went out */
+struct command_latency_t {
+    latency_figures_t challenged; /* From the challenge queue */
+    latency_figures_t mailbox; /* Via a mailbox challenge, right after hearing the node */
+};
+
+/* Progress of a group command across all of its targets */
+struct group_job_t {
+    std::string name;
+    steady_clock::time_point started;
+    size_t total;
+    size_t done;
+    size_t failed;
+};
+
 
 /* 
  * Below is compat w/RF24SensorNet 
@@ -27,10 +88,19 @@ enum pkt_type {
   PKT_CHALLENGE = 9,  /* Challenge */
 };
 
+/*
+ * Wire layouts are fixed: little-endian, fixed-width fields and explicit reserved
+ * bytes where the 32-bit ARM gateway used to get compiler padding, so the bytes on
+ * the air are the same whatever the gateway's word size. Layouts are checked below.
+ */
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+#error "pkt_* structs are little-endian wire views; this gateway needs a little-endian host"
+#endif
+
 /* Packet containing info about this node's power supply. */
 struct pkt_power_t {
-  bool battery; /* Is this node battery powered? */
-  bool solar; /* Does this node have a solar panel? */
+  uint8_t battery; /* Is this node battery powered? */
+  uint8_t solar; /* Does this node have a solar panel? */
   uint16_t vcc; /* Supply voltage */
   uint16_t vs; /* Voltage supplied by solar panel. 0 if not panel. */
   uint16_t id; /* ID for the battery, unique to this node */
@@ -40,7 +110,8 @@ struct pkt_power_t {
 struct pkt_switch_t {
   unsigned char hash[8]; /* Siphash */
   uint16_t id; /* ID for the switch, unique to this node. */
-  bool state; /* Is the switch on? */
+  uint8_t state; /* Is the switch on? */
+  uint8_t reserved;
   uint32_t timer; /* Seconds remaining until timer deactivates switch. 0 for no timer. */
 };
 
@@ -48,7 +119,8 @@ struct pkt_switch_t {
 struct pkt_rgb_t {
   unsigned char hash[8]; /* Siphash */
   uint16_t id; /* ID for the switch, unique to this node. */
-  char rgb[3]; /* 0-255 for RGB. Off is [0, 0, 0] */
+  uint8_t rgb[3]; /* 0-255 for RGB. Off is [0, 0, 0] */
+  uint8_t reserved[3];
   uint32_t timer; /* Seconds remaining until timer deactivates switch. 0 for no timer. */
 };
 
@@ -78,11 +150,57 @@ struct pkt_energy_t {
 
 /* Packet for reading/receiving challenges. */
 struct pkt_challenge_t {
-    time_t challenge;
+    uint32_t challenge; /* Seconds since the epoch, as the nodes' 32-bit time_t */
     uint8_t type;
+    uint8_t reserved[3];
 };
 
 /* Packet for time sync. */
 struct pkt_time_t {
-    time_t timestamp;
+    uint32_t timestamp; /* Seconds since the epoch, as the nodes' 32-bit time_t */
+};
+
+static_assert(sizeof(pkt_power_t) == 8 && offsetof(pkt_power_t, vcc) == 2 && offsetof(pkt_power_t, id) == 6, "pkt_power_t layout");
+static_assert(sizeof(pkt_switch_t) == 16 && offsetof(pkt_switch_t, id) == 8 && offsetof(pkt_switch_t, state) == 10 && offsetof(pkt_switch_t, timer) == 12, "pkt_switch_t layout");
+static_assert(sizeof(pkt_rgb_t) == 20 && offsetof(pkt_rgb_t, id) == 8 && offsetof(pkt_rgb_t, rgb) == 10 && offsetof(pkt_rgb_t, timer) == 16, "pkt_rgb_t layout");
+static_assert(sizeof(pkt_temp_t) == 4 && offsetof(pkt_temp_t, temp) == 2, "pkt_temp_t layout");
+static_assert(sizeof(pkt_humid_t) == 4 && offsetof(pkt_humid_t, humidity) == 2, "pkt_humid_t layout");
+static_assert(sizeof(pkt_moisture_t) == 4 && offsetof(pkt_moisture_t, moisture) == 2, "pkt_moisture_t layout");
+static_assert(sizeof(pkt_energy_t) == 4 && offsetof(pkt_energy_t, energy) == 2, "pkt_energy_t layout");
+static_assert(sizeof(pkt_challenge_t) == 8 && offsetof(pkt_challenge_t, type) == 4, "pkt_challenge_t layout");
+static_assert(sizeof(pkt_time_t) == 4, "pkt_time_t layout");
+
+/* AVR nodes pack these without the reserved bytes; read_frame widens them to the layouts above */
+const size_t PKT_SWITCH_PACKED = 15; /* state at 10, timer at 11 */
+const size_t PKT_RGB_PACKED = 17; /* rgb at 10, timer at 13 */
+const size_t PKT_CHALLENGE_PACKED = 5; /* challenge, type */
+
+/* Optional trailer on uplink frames: siphash of payload, sequence, node and type under the gateway key */
+struct pkt_auth_t {
+    uint32_t sequence; /* Strictly increasing per node, across reboots */
+    unsigned char hash[8]; /* Siphash */
+};
+
+static_assert(sizeof(pkt_auth_t) == 12 && offsetof(pkt_auth_t, hash) == 4, "pkt_auth_t layout");
+
+/* Counters for uplink frame authentication */
+struct auth_stats_t {
+    uint64_t verified;
+    uint64_t bad_hash;
+    uint64_t replayed;
+    uint64_t unsigned_frames; /* Unsigned frames from nodes required to sign */
+};
+
+/* Receive buffer viewed in place as whichever packet the header type names */
+union wire_frame_t {
+    uint8_t raw[32];
+    pkt_power_t power;
+    pkt_switch_t sw;
+    pkt_rgb_t rgb;
+    pkt_temp_t temp;
+    pkt_humid_t humid;
+    pkt_moisture_t moisture;
+    pkt_energy_t energy;
+    pkt_challenge_t challenge;
+    pkt_time_t time;
 };
@@ -0,0 +1,176 @@
+#include <algorithm>
+#include <utility>
+#include "RadioScheduler.h"
+
+RadioScheduler::RadioScheduler(void) : bitrate(250000), budget_us(0), tokens_us(0), refilled_at(steady_clock::now()) {
+    for (auto &c : this->classes) {
+        c.stats = radio_class_stats_t { 0, 0, 0, 0, 0 };
+    }
+}
+
+void RadioScheduler::set_airtime_budget(uint32_t _bitrate, uint32_t _budget_us) {
+    this->bitrate = _bitrate;
+    this->budget_us = _budget_us;
+    this->tokens_us = _budget_us;
+    this->refilled_at = steady_clock::now();
+}
+
+/*
+ * Queue a frame; returns true, with the frame dropped, if the class was full and lost its oldest frame
+ */
+bool RadioScheduler::enqueue(uint8_t priority, uint16_t node, unsigned char type, const void* message, size_t len, scheduled_frame_t& dropped) {
+    priority = std::min<size_t>(priority, RADIO_PRIORITY_COUNT - 1);
+    auto &c = this->classes[priority];
+    auto bytes = static_cast<const uint8_t*>(message);
+    auto now = steady_clock::now();
+
+    auto full = c.stats.depth >= RADIO_CLASS_LIMITS[priority];
+    if (full) {
+        // Each node's front frame is its oldest, retries included
+        auto oldest = std::min_element(c.rotation.begin(), c.rotation.end(), [&c](uint16_t a, uint16_t b) {
+            return c.frames[a].front().queued_at < c.frames[b].front().queued_at;
+        });
+        auto &frames = c.frames[*oldest];
+        dropped = std::move(frames.front());
+        frames.pop_front();
+        if (frames.empty()) {
+            c.frames.erase(*oldest);
+            c.rotation.erase(oldest);
+        }
+        c.stats.depth--;
+        c.stats.dropped++;
+    }
+
+    auto &frames = c.frames[node];
+    if (frames.empty()) {
+        c.rotation.push_back(node);
+    }
+    frames.push_back(scheduled_frame_t { node, type, std::vector<uint8_t>(bytes, bytes + len), now, now, priority, 0 });
+    c.stats.depth++;
+    return full;
+}
+
+/*
+ * Put a frame whose write failed back at the head of its node's queue, due again at not_before
+ */
+void RadioScheduler::retry(scheduled_frame_t& frame, steady_clock::time_point not_before) {
+    auto &c = this->classes[frame.priority];
+
+    auto &frames = c.frames[frame.node];
+    if (frames.empty()) {
+        c.rotation.push_back(frame.node);
+    }
+    frame.not_before = not_before;
+    frame.attempt++;
+    frames.push_front(std::move(frame));
+    c.stats.depth++;
+}
+
+/*
+ * Move a node's waiting frames of this type from lower classes up to priority, keeping their order;
+ * returns how many moved
+ */
+size_t RadioScheduler::promote(uint16_t node, unsigned char type, uint8_t priority) {
+    auto &to = this->classes[priority];
+    auto moved = size_t(0);
+
+    for (auto p = size_t(priority) + 1; p < RADIO_PRIORITY_COUNT; p++) {
+        auto &c = this->classes[p];
+        auto found = c.frames.find(node);
+        if (found == c.frames.end()) {
+            continue;
+        }
+
+        auto &frames = found->second;
+        for (auto it = frames.begin(); it != frames.end(); ) {
+            if (it->type != type) {
+                ++it;
+                continue;
+            }
+
+            auto &target = to.frames[node];
+            if (target.empty()) {
+                to.rotation.push_back(node);
+            }
+            it->priority = priority;
+            target.push_back(std::move(*it));
+            it = frames.erase(it);
+            c.stats.depth--;
+            to.stats.depth++;
+            moved++;
+        }
+
+        if (frames.empty()) {
+            c.frames.erase(found);
+            c.rotation.erase(std::find(c.rotation.begin(), c.rotation.end(), node));
+        }
+    }
+
+    return moved;
+}
+
+/*
+ * Pop the next frame allowed on the air; false when nothing is queued or the budget is spent
+ */
+bool RadioScheduler::next(scheduled_frame_t& frame, steady_clock::time_point now) {
+    if (this->budget_us > 0) {
+        auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(now - this->refilled_at).count();
+        this->tokens_us = std::min<double>(this->budget_us, this->tokens_us + elapsed * (this->budget_us / 1000000.0));
+        this->refilled_at = now;
+    }
+
+    for (auto &c : this->classes) {
+        auto ready = std::find_if(c.rotation.begin(), c.rotation.end(), 
+            [&c, now](uint16_t node) { return c.frames[node].front().not_before <= now; });
+        if (ready == c.rotation.end()) {
+            continue;
+        }
+
+        auto node = *ready;
+        auto &frames = c.frames[node];
+
+        // Strict priority: lower classes never jump ahead of a waiting higher class
+        auto cost = this->airtime_us(frames.front().payload.size());
+        if (this->budget_us > 0 && this->tokens_us < cost && this->tokens_us < this->budget_us) {
+            return false;
+        }
+        this->tokens_us -= cost;
+
+        frame = std::move(frames.front());
+        frames.pop_front();
+        c.rotation.erase(ready);
+        if (frames.empty()) {
+            c.frames.erase(node);
+        } else {
+            c.rotation.push_back(node);
+        }
+
+        uint64_t wait = std::chrono::duration_cast<std::chrono::microseconds>(now - frame.queued_at).count();
+        c.stats.depth--;
+        c.stats.sent++;
+        c.stats.total_wait_us += wait;
+        c.stats.max_wait_us = std::max(c.stats.max_wait_us, wait);
+        return true;
+    }
+
+    return false;
+}
+
+void RadioScheduler::reset_max_wait(void) {
+    for (auto &c : this->classes) {
+        c.stats.max_wait_us = 0;
+    }
+}
+
+/*
+ * Estimated time on air, in microseconds, for a frame and its auto-ack
+ */
+uint32_t RadioScheduler::airtime_us(size_t len) const {
+    // preamble + address + RF24Network header + payload + crc, plus the 9 bit packet control field
+    const size_t overhead_bytes = 1 + 5 + 8 + 2;
+    const uint32_t settle_us = 130;
+
+    auto frame_bits = (overhead_bytes + len) * 8 + 9;
+    auto ack_bits = (overhead_bytes - 8) * 8 + 9;
+    return (frame_bits + ack_bits) * 1000000ULL / this->bitrate + 2 * settle_us;
+}
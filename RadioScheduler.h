@@ -0,0 +1,77 @@
+#pragma once
+
+#include <array>
+#include <deque>
+#include <vector>
+#include <unordered_map>
+#include <stdint.h>
+#include "RF24Node_types.h"
+
+/* Outbound priority classes, most urgent first */
+enum radio_priority {
+    PRIORITY_COMMAND = 0, /* Signed switch/rgb commands */
+    PRIORITY_CHALLENGE = 1, /* Challenge requests */
+    PRIORITY_TIMESYNC = 2, /* Time replies */
+};
+const size_t RADIO_PRIORITY_COUNT = 3;
+
+/* Most frames each class holds; beyond that its oldest frame is dropped */
+const size_t RADIO_CLASS_LIMITS[] = { 256, 256, 32 };
+
+/* A frame waiting for its turn on the air */
+struct scheduled_frame_t {
+    uint16_t node;
+    unsigned char type;
+    std::vector<uint8_t> payload;
+    steady_clock::time_point queued_at;
+    steady_clock::time_point not_before; /* Held back until then, e.g. spacing between retries */
+    uint8_t priority;
+    uint8_t attempt; /* Writes already made, 0 for a fresh frame */
+};
+
+/* Counters for a single priority class */
+struct radio_class_stats_t {
+    size_t depth;
+    uint64_t sent;
+    uint64_t dropped; /* Oldest frames dropped because the class was full */
+    uint64_t total_wait_us;
+    uint64_t max_wait_us;
+};
+
+/*
+ * Orders outbound frames by strict priority, round-robin across nodes within a class,
+ * and holds them back when the airtime budget for the current second is spent.
+ * A node whose next frame is not due yet (a spaced retry) does not hold up the others.
+ */
+class RadioScheduler {
+    public:
+        RadioScheduler(void);
+
+        void set_airtime_budget(uint32_t _bitrate, uint32_t _budget_us);
+        bool enqueue(uint8_t priority, uint16_t node, unsigned char type, const void* message, size_t len, scheduled_frame_t& dropped);
+        void retry(scheduled_frame_t& frame, steady_clock::time_point not_before);
+        size_t promote(uint16_t node, unsigned char type, uint8_t priority);
+        bool next(scheduled_frame_t& frame, steady_clock::time_point now);
+
+        const radio_class_stats_t& stats(uint8_t priority) const {
+            return this->classes[priority].stats;
+        }
+
+        void reset_max_wait(void);
+
+    protected:
+        struct class_queue_t {
+            std::deque<uint16_t> rotation;
+            std::unordered_map<uint16_t, std::deque<scheduled_frame_t>> frames;
+            radio_class_stats_t stats;
+        };
+
+        std::array<class_queue_t, RADIO_PRIORITY_COUNT> classes;
+
+        uint32_t bitrate;
+        uint32_t budget_us; /* Airtime allowed per second; 0 for unlimited */
+        double tokens_us;
+        steady_clock::time_point refilled_at;
+
+        uint32_t airtime_us(size_t len) const;
+};
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <stdint.h>
+
+/*
+ * Sliding window over a node's uplink sequence counter: the highest sequence seen
+ * and a bitmap of which of the 64 sequences at or below it have been accepted.
+ */
+class ReplayWindow {
+    public:
+        ReplayWindow(void) : highest(0), seen(0) { }
+
+        /* Accept (and remember) a sequence; false for replays and sequences too old to judge */
+        bool accept(uint32_t sequence) {
+            if (sequence > this->highest || this->seen == 0) {
+                auto shift = sequence - this->highest;
+                this->seen = (this->seen == 0 || shift >= 64) ? 1 : (this->seen << shift) | 1;
+                this->highest = sequence;
+                return true;
+            }
+
+            auto age = this->highest - sequence;
+            if (age >= 64 || (this->seen & (uint64_t(1) << age))) {
+                return false;
+            }
+
+            this->seen |= uint64_t(1) << age;
+            return true;
+        }
+
+    protected:
+        uint32_t highest;
+        uint64_t seen;
+};
@@ -0,0 +1,81 @@
+#include <algorithm>
+#include <utility>
+#include "SensorHistory.h"
+
+/*
+ * Add a reading to every resolution; returns the buckets that the reading closed
+ */
+std::vector<history_summary_t> SensorHistory::record(uint16_t node, uint8_t type, uint16_t id, double value, time_t now) {
+    auto closed = std::vector<history_summary_t>();
+
+    auto key = series_key(node, type, id);
+    auto found = this->series.find(key);
+    if (found == this->series.end()) {
+        auto fresh = series_t();
+        for (size_t r = 0; r < HISTORY_RESOLUTION_COUNT; r++) {
+            fresh.rings[r].current = -1;
+            fresh.rings[r].buckets.assign(HISTORY_BUCKETS[r], history_bucket_t { 0, 0, 0, 0, 0 });
+        }
+        found = this->series.insert(std::make_pair(key, std::move(fresh))).first;
+    }
+
+    for (size_t r = 0; r < HISTORY_RESOLUTION_COUNT; r++) {
+        auto resolution = HISTORY_RESOLUTIONS[r];
+        auto &ring = found->second.rings[r];
+        auto start = now - (now % resolution);
+        auto &bucket = ring.buckets[(start / resolution) % HISTORY_BUCKETS[r]];
+
+        // The previous bucket is complete once a reading lands in a newer one
+        if (ring.current != start) {
+            if (ring.current >= 0) {
+                auto &previous = ring.buckets[(ring.current / resolution) % HISTORY_BUCKETS[r]];
+                if (previous.count > 0 && previous.start == ring.current) {
+                    closed.push_back(history_summary_t { node, type, id, resolution, previous });
+                }
+            }
+            ring.current = start;
+        }
+
+        // Reuse a slot left over from an earlier lap around the ring
+        if (bucket.start != start || bucket.count == 0) {
+            bucket = history_bucket_t { start, value, value, 0, 0 };
+        }
+
+        bucket.min = std::min(bucket.min, value);
+        bucket.max = std::max(bucket.max, value);
+        bucket.sum += value;
+        bucket.count++;
+    }
+
+    return closed;
+}
+
+/*
+ * Return the non-empty buckets still in the window for a resolution, oldest first
+ */
+std::vector<history_bucket_t> SensorHistory::query(uint16_t node, uint8_t type, uint16_t id, uint32_t resolution, time_t now) const {
+    auto result = std::vector<history_bucket_t>();
+
+    auto found = this->series.find(series_key(node, type, id));
+    if (found == this->series.end()) {
+        return result;
+    }
+
+    for (size_t r = 0; r < HISTORY_RESOLUTION_COUNT; r++) {
+        if (HISTORY_RESOLUTIONS[r] != resolution) {
+            continue;
+        }
+
+        auto &ring = found->second.rings[r];
+        auto newest = now - (now % resolution);
+        auto oldest = newest - time_t(resolution * (HISTORY_BUCKETS[r] - 1));
+        for (auto start = oldest; start <= newest; start += resolution) {
+            auto &bucket = ring.buckets[(start / resolution) % HISTORY_BUCKETS[r]];
+            if (bucket.count > 0 && bucket.start == start) {
+                result.push_back(bucket);
+            }
+        }
+    }
+
+    return result;
+}
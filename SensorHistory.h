@@ -0,0 +1,56 @@
+#pragma once
+
+#include <array>
+#include <vector>
+#include <unordered_map>
+#include <stdint.h>
+#include <ctime>
+
+/* A single downsampled bucket; count == 0 means the bucket is empty */
+struct history_bucket_t {
+    time_t start;
+    double min;
+    double max;
+    double sum;
+    uint32_t count;
+
+    double mean(void) const { return this->count > 0 ? this->sum / this->count : 0; }
+};
+
+/* A bucket that was closed by a newer reading, ready to be published */
+struct history_summary_t {
+    uint16_t node;
+    uint8_t type;
+    uint16_t id;
+    uint32_t resolution;
+    history_bucket_t bucket;
+};
+
+/* 1-minute buckets for an hour, 15-minute buckets for a day, hourly buckets for a week */
+const uint32_t HISTORY_RESOLUTIONS[] = { 60, 900, 3600 };
+const size_t HISTORY_RESOLUTION_COUNT = 3;
+const size_t HISTORY_BUCKETS[] = { 60, 96, 168 };
+
+class SensorHistory {
+    public:
+        std::vector<history_summary_t> record(uint16_t node, uint8_t type, uint16_t id, double value, time_t now);
+        std::vector<history_bucket_t> query(uint16_t node, uint8_t type, uint16_t id, uint32_t resolution, time_t now) const;
+
+    protected:
+        /* Ring of HISTORY_BUCKETS[r] buckets for one resolution */
+        struct ring_t {
+            std::vector<history_bucket_t> buckets;
+            time_t current;
+        };
+
+        /* All resolutions for a single (node, type, id) */
+        struct series_t {
+            std::array<ring_t, HISTORY_RESOLUTION_COUNT> rings;
+        };
+
+        static uint64_t series_key(uint16_t node, uint8_t type, uint16_t id) {
+            return (uint64_t(node) << 24) | (uint64_t(type) << 16) | id;
+        }
+
+        std::unordered_map<uint64_t, series_t> series;
+};
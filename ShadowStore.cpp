@@ -0,0 +1,109 @@
+#include "ShadowStore.h"
+#include "StringSplit.h"
+
+/*
+ * Pull the id, normalised state and timer out of a switch ("id|state|timer") or rgb ("id|r|g|b|timer") command
+ */
+bool ShadowStore::parse_command(uint8_t type, const std::string& payload, uint16_t& id, std::string& state, uint32_t& timer) {
+    auto elements = split(payload, '|');
+
+    if (type == PKT_SWITCH && elements.size() >= 3) {
+        id = std::stoi(elements[0], nullptr, 0);
+        state = std::stoi(elements[1], nullptr, 0) != 0 ? "1" : "0";
+        timer = std::stoul(elements[2], nullptr, 0);
+        return true;
+    }
+
+    if (type == PKT_RGB && elements.size() >= 5) {
+        id = std::stoi(elements[0], nullptr, 0);
+        state = std::to_string(std::stoi(elements[1], nullptr, 0) & 0xFF) + "|" +
+            std::to_string(std::stoi(elements[2], nullptr, 0) & 0xFF) + "|" +
+            std::to_string(std::stoi(elements[3], nullptr, 0) & 0xFF);
+        timer = std::stoul(elements[4], nullptr, 0);
+        return true;
+    }
+
+    return false;
+}
+
+/*
+ * Record a requested state; returns true if the command needs to go out over the air.
+ * Only suppressed when nothing is queued or in flight that could still change the actuator.
+ */
+bool ShadowStore::request(uint16_t node, uint8_t type, uint16_t id, const std::string& state, const std::string& payload, bool reconcile, bool queued, steady_clock::time_point now) {
+    auto key = shadow_key(node, type, id);
+    auto &shadow = this->shadows[key];
+    shadow.desired = state;
+    shadow.payload = payload;
+    shadow.reconcile = reconcile;
+    this->drifted.erase(key);
+
+    // Timed commands always go out; the node needs the new timer even if the state matches
+    if (reconcile && !queued && !shadow.in_flight && shadow.reported == state) {
+        this->suppressed++;
+        return false;
+    }
+
+    shadow.last_queued = now;
+    return true;
+}
+
+/*
+ * Record that a command was signed and sent; its effect is unknown until the node reports
+ */
+void ShadowStore::sent(uint16_t node, uint8_t type, uint16_t id) {
+    auto found = this->shadows.find(shadow_key(node, type, id));
+    if (found != this->shadows.end()) {
+        found->second.in_flight = true;
+    }
+}
+
+/*
+ * Record a reported state; returns true, with the payload to resend, if the actuator drifted
+ * and no command for it is still queued
+ */
+bool ShadowStore::report(uint16_t node, uint8_t type, uint16_t id, const std::string& state, bool queued, steady_clock::time_point now, std::string& payload) {
+    auto key = shadow_key(node, type, id);
+    auto &shadow = this->shadows[key];
+    shadow.reported = state;
+    shadow.in_flight = false;
+
+    if (queued || shadow.desired.empty() || !shadow.reconcile || shadow.desired == state) {
+        this->drifted.erase(key);
+        return false;
+    }
+
+    // Give an in-flight command time to land before resending; due() picks it up after
+    if (now - shadow.last_queued < this->holdoff) {
+        this->drifted.insert(key);
+        return false;
+    }
+
+    this->drifted.erase(key);
+    shadow.last_queued = now;
+    payload = shadow.payload;
+    this->reconciled++;
+    return true;
+}
+
+/*
+ * Drift reported inside the holdoff whose holdoff has now passed, with the payloads to resend
+ */
+std::vector<shadow_resend_t> ShadowStore::due(steady_clock::time_point now) {
+    auto resends = std::vector<shadow_resend_t>();
+
+    for (auto it = this->drifted.begin(); it != this->drifted.end(); ) {
+        auto &shadow = this->shadows[*it];
+        if (now - shadow.last_queued < this->holdoff) {
+            ++it;
+            continue;
+        }
+
+        shadow.last_queued = now;
+        this->reconciled++;
+        resends.push_back(shadow_resend_t { uint16_t(*it >> 24), uint8_t(*it >> 16), uint16_t(*it), shadow.payload });
+        it = this->drifted.erase(it);
+    }
+
+    return resends;
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include <stdint.h>
+#include "RF24Node_types.h"
+
+/* Desired vs reported state for one actuator; states are normalised ("1", "255|0|0") */
+struct shadow_t {
+    std::string desired; /* Empty until a command is received */
+    std::string reported; /* Empty until the node reports */
+    std::string payload; /* Command payload that produces the desired state */
+    bool reconcile; /* False for timed commands, which revert on their own */
+    bool in_flight; /* Sent to the node, which has not reported since */
+    steady_clock::time_point last_queued;
+};
+
+/* A desired command to resend because its actuator drifted */
+struct shadow_resend_t {
+    uint16_t node;
+    uint8_t type;
+    uint16_t id;
+    std::string payload;
+};
+
+/*
+ * Remembers what each switch/rgb actuator was asked to do and what it last reported,
+ * so commands already in effect are not resent and drift is corrected automatically.
+ */
+class ShadowStore {
+    public:
+        ShadowStore(void) : holdoff(std::chrono::seconds(10)), suppressed(0), reconciled(0) { }
+
+        static bool parse_command(uint8_t type, const std::string& payload, uint16_t& id, std::string& state, uint32_t& timer);
+
+        bool request(uint16_t node, uint8_t type, uint16_t id, const std::string& state, const std::string& payload, bool reconcile, bool queued, steady_clock::time_point now);
+        void sent(uint16_t node, uint8_t type, uint16_t id);
+        bool report(uint16_t node, uint8_t type, uint16_t id, const std::string& state, bool queued, steady_clock::time_point now, std::string& payload);
+        std::vector<shadow_resend_t> due(steady_clock::time_point now);
+
+        uint64_t get_suppressed(void) const { return this->suppressed; }
+        uint64_t get_reconciled(void) const { return this->reconciled; }
+        size_t size(void) const { return this->shadows.size(); }
+
+    protected:
+        static uint64_t shadow_key(uint16_t node, uint8_t type, uint16_t id) {
+            return (uint64_t(node) << 24) | (uint64_t(type) << 16) | id;
+        }
+
+        std::unordered_map<uint64_t, shadow_t> shadows;
+        std::unordered_set<uint64_t> drifted; /* Drift seen inside the holdoff, resent by due() */
+        steady_clock::duration holdoff;
+        uint64_t suppressed;
+        uint64_t reconciled;
+};
@@ -0,0 +1,78 @@
+#include "ShardTable.h"
+
+/*
+ * Remember a node heard on our own radio; returns true the first time
+ */
+bool ShardTable::heard(uint16_t node) {
+    return this->local.insert(node).second;
+}
+
+/*
+ * Record another gateway's heartbeat and the nodes it has heard
+ */
+void ShardTable::announce(std::string gateway, std::set<uint16_t> nodes, steady_clock::time_point now) {
+    if (gateway == this->self) {
+        return;
+    }
+
+    auto &announcement = this->gateways[gateway];
+    announcement.nodes = nodes;
+    announcement.last_seen = now;
+}
+
+/*
+ * Forget gateways that stopped heartbeating; returns true if any were dropped
+ */
+bool ShardTable::expire(steady_clock::time_point now, steady_clock::duration timeout) {
+    auto changed = false;
+    for (auto it = this->gateways.begin(); it != this->gateways.end(); ) {
+        if (now - it->second.last_seen > timeout) {
+            it = this->gateways.erase(it);
+            changed = true;
+        } else {
+            ++it;
+        }
+    }
+    return changed;
+}
+
+bool ShardTable::is_default(void) const {
+    for (auto &gateway : this->gateways) {
+        if (gateway.first < this->self) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+ * Should commands for this node be handled by this gateway?
+ */
+bool ShardTable::handles(uint16_t node) const {
+    auto o = this->owner(node);
+    return o == this->self || (o.empty() && this->is_default());
+}
+
+std::set<uint16_t> ShardTable::owned(void) const {
+    auto nodes = std::set<uint16_t>();
+    for (auto node : this->local) {
+        if (this->owner(node) == this->self) {
+            nodes.insert(node);
+        }
+    }
+    return nodes;
+}
+
+std::string ShardTable::owner(uint16_t node) const {
+    auto o = std::string();
+    if (this->local.count(node)) {
+        o = this->self;
+    }
+
+    for (auto &gateway : this->gateways) {
+        if (gateway.second.nodes.count(node) && (o.empty() || gateway.first < o)) {
+            o = gateway.first;
+        }
+    }
+    return o;
+}
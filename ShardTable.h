@@ -0,0 +1,47 @@
+#pragma once
+
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <stdint.h>
+#include "RF24Node_types.h"
+
+/* The last announcement heard from a gateway */
+struct gateway_announcement_t {
+    std::set<uint16_t> nodes;
+    steady_clock::time_point last_seen;
+};
+
+/*
+ * Decides which gateway owns which node.
+ *
+ * A node is owned by the lowest gateway id, among live gateways, that has heard it.
+ * The lowest live gateway id is the default and also takes nodes nobody has heard.
+ */
+class ShardTable {
+    public:
+        ShardTable(void) { }
+
+        void set_self(std::string _self) {
+            this->self = _self;
+        }
+
+        bool heard(uint16_t node);
+        void announce(std::string gateway, std::set<uint16_t> nodes, steady_clock::time_point now);
+        bool expire(steady_clock::time_point now, steady_clock::duration timeout);
+
+        bool is_default(void) const;
+        bool handles(uint16_t node) const;
+        std::set<uint16_t> owned(void) const;
+
+        const std::set<uint16_t>& heard_nodes(void) const {
+            return this->local;
+        }
+
+    protected:
+        std::string self;
+        std::set<uint16_t> local;
+        std::unordered_map<std::string, gateway_announcement_t> gateways;
+
+        std::string owner(uint16_t node) const;
+};
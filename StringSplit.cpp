@@ -1,4 +1,6 @@
+#include <cctype>
 #include <sstream>
+#include <stdexcept>
 #include "StringSplit.h"
 
 std::vector<std::string> split(const std::string &s, char delim) {
@@ -14,3 +16,17 @@ std::vector<std::string> split(const std::string &s, char delim) {
 }
 
 
+
+bool parse_number(const std::string &s, unsigned long &value) {
+    if (s.empty() || s[0] == '-' || s[0] == '+' || isspace(s[0])) {
+        return false;
+    }
+
+    try {
+        auto idx = size_t(0);
+        value = std::stoul(s, &idx, 0);
+        return idx == s.size();
+    } catch (const std::exception&) {
+        return false;
+    }
+}
@@ -4,3 +4,6 @@
 #include <vector>
 
 std::vector<std::string> split(const std::string &s, char delim);
+
+/* Parse the whole string as an unsigned number (base 0: decimal, 0x hex or 0 octal); false if any of it isn't */
+bool parse_number(const std::string &s, unsigned long &value);
@@ -0,0 +1,187 @@
+/*
+ * Heap allocations per inbound command
+ *
+ * Replaces the global operator new with a counting one and drives an rgb command
+ * through MQTTWrapper::on_message -> RF24Node::handle_receive_message -> queue_command,
+ * then the challenge out and, on the node's response, handle_send_rgb. Prints the
+ * average allocations (and bytes) per command for each stage once warmed up.
+ *
+ * The first stage is also run through a copy of the previous on_message, which
+ * sized the body with strlen and passed subject and body to the callback by value,
+ * so the two can be compared in one run.
+ *
+ *   make bench && bench/inbound_allocs [commands]
+ */
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <functional>
+#include <new>
+#include <string>
+#include <vector>
+
+#include <mosquittopp.h>
+#include "RF24Network/RF24Network.h"
+#include "IRadioNetwork.h"
+#include "MQTTWrapper.h"
+#include "RF24Node_types.h"
+#include "RF24Node.h"
+#include "Logger.h"
+
+static std::atomic<size_t> allocations(0);
+static std::atomic<size_t> allocated_bytes(0);
+
+// Kept out of line so the compiler does not pair an inlined free() with a new expression
+__attribute__((noinline)) void* operator new(size_t n) {
+    allocations++;
+    allocated_bytes += n;
+    if (auto p = malloc(n > 0 ? n : 1)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+__attribute__((noinline)) void operator delete(void* p) noexcept {
+    free(p);
+}
+
+/* The real on_message, without a broker connection */
+class BenchMQTT: public MQTTWrapper {
+    public:
+        BenchMQTT(void) : MQTTWrapper("bench", "localhost", 1883, "", "", "", false) { }
+
+        void begin(void) { }
+        void loop(void) { }
+        bool connected(void) { return true; }
+        void send_message(const std::string& subject, const std::string& body) { }
+
+        void deliver(const struct mosquitto_message *message) {
+            this->on_message(message);
+        }
+};
+
+/* on_message as it was before bodies were moved: strlen for the length and copies by value */
+class LegacyMQTT {
+    public:
+        void set_on_message_callback(std::function<void(std::string, std::string)> cb) {
+            this->cb = cb;
+        }
+
+        void deliver(const struct mosquitto_message *message) {
+            auto subject = std::string(message->topic);
+            auto body = message->payloadlen > 0 ? 
+                std::string(reinterpret_cast<char *>(message->payload)) : std::string("");
+            this->cb(subject, body);
+        }
+
+    protected:
+        std::function<void(std::string, std::string)> cb;
+};
+
+/* Answers a challenge when told to; swallows writes */
+class BenchRadio: public IRadioNetwork {
+    public:
+        BenchRadio(void) : pending(false) { }
+
+        bool available(void) {
+            return this->pending;
+        }
+
+        void peek(RF24NetworkHeader& header) {
+            header.from_node = 01;
+            header.to_node = 00;
+            header.type = PKT_CHALLENGE;
+        }
+
+        size_t read(RF24NetworkHeader& header, void* message, size_t maxlen) {
+            this->peek(header);
+            this->pending = false;
+
+            auto response = pkt_challenge_t { static_cast<uint32_t>(time(0)), PKT_RGB, { 0, 0, 0 } };
+            memcpy(message, &response, sizeof(response));
+            return sizeof(response);
+        }
+
+        bool write(RF24NetworkHeader& header, const void* message, size_t len) {
+            return true;
+        }
+
+        bool pending;
+};
+
+/* Running totals for one stage */
+struct stage_t {
+    const char* name;
+    size_t allocations;
+    size_t bytes;
+};
+
+template<typename F>
+static void measure(stage_t& stage, F f) {
+    auto a = allocations.load();
+    auto b = allocated_bytes.load();
+    f();
+    stage.allocations += allocations.load() - a;
+    stage.bytes += allocated_bytes.load() - b;
+}
+
+int main(int argc, char *argv[]) {
+    auto commands = size_t(argc > 1 ? strtoul(argv[1], nullptr, 0) : 10000);
+
+    auto radio = BenchRadio();
+    auto broker = BenchMQTT();
+    auto key = std::vector<char>(16, 0);
+
+    RF24Node node(radio, broker, key);
+    node.set_debug(false);
+    node.begin();
+
+    // Longer than the small string buffer, as a real rgb command with a timer is
+    char topic[] = "/sensornet/in/1/67";
+    char bodies[2][24] = { "1|255|128|64|3600", "1|0|0|0|3600" };
+
+    auto message = mosquitto_message();
+    message.topic = topic;
+
+    // on_message alone, handing the body to a callback that keeps it
+    auto sink = std::string();
+    auto bare = BenchMQTT();
+    bare.set_on_message_callback([&sink](const std::string& subject, std::string&& body) { sink = std::move(body); });
+    auto legacy = LegacyMQTT();
+    legacy.set_on_message_callback([&sink](std::string subject, std::string body) { sink = body; });
+
+    stage_t stages[] = {
+        { "on_message, by value (before)", 0, 0 },
+        { "on_message (subject + body)", 0, 0 },
+        { "on_message -> queue_command", 0, 0 },
+        { "loop: challenge out", 0, 0 },
+        { "loop: challenge in -> handle_send_rgb", 0, 0 },
+    };
+
+    // The first round fills maps and the logger's ring; only later rounds are counted
+    for (size_t i = 0; i <= commands; i++) {
+        auto &body = bodies[i % 2];
+        message.payload = body;
+        message.payloadlen = strlen(body);
+
+        stage_t scratch[5] = { { "", 0, 0 }, { "", 0, 0 }, { "", 0, 0 }, { "", 0, 0 }, { "", 0, 0 } };
+        auto counted = i > 0 ? stages : scratch;
+
+        measure(counted[0], [&]() { legacy.deliver(&message); });
+        measure(counted[1], [&]() { bare.deliver(&message); });
+        measure(counted[2], [&]() { broker.deliver(&message); });
+        measure(counted[3], [&]() { node.loop(); });
+        radio.pending = true;
+        measure(counted[4], [&]() { node.loop(); });
+    }
+    node.end();
+
+    printf("commands: %zu\n", commands);
+    for (auto &stage : stages) {
+        printf("%-40s %6.2f allocations, %7.1f bytes per command\n", stage.name, 
+            double(stage.allocations) / commands, double(stage.bytes) / commands);
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,131 @@
+/*
+ * Gateway throughput with verbose logging on vs off
+ *
+ * Feeds a fixed mix of sensor and switch frames through RF24Node::loop() from an
+ * in-memory radio, once at info level and once at debug (the init script's -v),
+ * and reports frames per second for each. Log output goes to the file named on
+ * the command line, /dev/null by default.
+ *
+ *   make bench && bench/log_throughput [frames] [log_file]
+ */
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "RF24Network/RF24Network.h"
+#include "IMessageProtocol.h"
+#include "IRadioNetwork.h"
+#include "RF24Node_types.h"
+#include "RF24Node.h"
+#include "Logger.h"
+
+/* Hands out the same few frames, a handful per update() like a busy radio */
+class BenchRadio: public IRadioNetwork {
+    public:
+        BenchRadio(size_t _frames) : remaining(_frames), batch(0), next(0) { }
+
+        void update(void) {
+            this->batch = std::min<size_t>(8, this->remaining);
+        }
+
+        bool available(void) {
+            return this->batch > 0;
+        }
+
+        void peek(RF24NetworkHeader& header) {
+            header.from_node = 01 + (this->next % 5);
+            header.to_node = 00;
+            header.type = types[this->next % (sizeof(types) / sizeof(types[0]))];
+        }
+
+        size_t read(RF24NetworkHeader& header, void* message, size_t maxlen) {
+            this->peek(header);
+            this->next++;
+            this->batch--;
+            this->remaining--;
+
+            auto frame = wire_frame_t();
+            auto len = size_t(0);
+            switch (header.type) {
+                case PKT_TEMP:
+                    frame.temp = pkt_temp_t { 1, 215 };
+                    len = sizeof(pkt_temp_t);
+                    break;
+                case PKT_HUMID:
+                    frame.humid = pkt_humid_t { 1, 480 };
+                    len = sizeof(pkt_humid_t);
+                    break;
+                case PKT_POWER:
+                    frame.power = pkt_power_t { 1, 0, 3300, 0, 1 };
+                    len = sizeof(pkt_power_t);
+                    break;
+                case PKT_SWITCH:
+                    frame.sw.id = 1;
+                    frame.sw.state = this->next % 2;
+                    len = sizeof(pkt_switch_t);
+                    break;
+            }
+            memcpy(message, frame.raw, std::min(len, maxlen));
+            return std::min(len, maxlen);
+        }
+
+        bool write(RF24NetworkHeader& header, const void* message, size_t len) {
+            return true;
+        }
+
+        bool done(void) const {
+            return this->remaining == 0;
+        }
+
+    protected:
+        static const unsigned char types[4];
+        size_t remaining;
+        size_t batch;
+        size_t next;
+};
+
+const unsigned char BenchRadio::types[4] = { PKT_TEMP, PKT_HUMID, PKT_POWER, PKT_SWITCH };
+
+/*
+ * Frames per second through RF24Node::loop() at the given verbosity
+ */
+static double run(size_t frames, bool verbose) {
+    auto radio = BenchRadio(frames);
+    auto broker = IMessageProtocol();
+    auto key = std::vector<char>(16, 0);
+
+    RF24Node node(radio, broker, key);
+    node.set_debug(verbose);
+    node.begin();
+
+    auto started = std::chrono::steady_clock::now();
+    while (!radio.done()) {
+        node.loop();
+    }
+    auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+
+    node.end();
+    return frames / elapsed;
+}
+
+int main(int argc, char *argv[]) {
+    auto frames = size_t(argc > 1 ? strtoul(argv[1], nullptr, 0) : 200000);
+    auto log_file = argc > 2 ? argv[2] : "/dev/null";
+
+    if (!logger.open_file(log_file)) {
+        fprintf(stderr, "Unable to open log file '%s'\n", log_file);
+        return EXIT_FAILURE;
+    }
+    logger.start();
+
+    auto quiet = run(frames, false);
+    auto verbose = run(frames, true);
+    logger.stop();
+
+    printf("frames: %zu\n", frames);
+    printf("verbose off: %.0f frames/s\n", quiet);
+    printf("verbose on:  %.0f frames/s (%.1f%%)\n", verbose, 100.0 * verbose / quiet);
+    return EXIT_SUCCESS;
+}